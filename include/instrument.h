@@ -1,9 +1,27 @@
 
 namespace imajuscule::audio {
 
+namespace detail {
+  template<typename T, typename = void>
+  struct HasPrepareProgram : std::false_type {};
+
+  template<typename T>
+  struct HasPrepareProgram<T, std::void_t<decltype(std::declval<T&>().prepareProgram(0))>> : std::true_type {};
+}
+
 // this is a "one for all" type of class, initially designed to handle
 // wind which has infinite length notes (hence the way n_notes is modified)
 // and that is now used to play birds.
+//
+// Programs can be prepared on a background thread (see 'preloadPrograms') so that
+// the first note played with a program doesn't pay for its initialization:
+// - If 'INST' has a 'prepareProgram(int)' method, it is called on the background thread.
+// It must be safe to call while notes are played with other programs : a program
+// is never used by a note while it is being prepared.
+// - Else, the background thread constructs an instance of 'INST' dedicated to the program,
+// and calls its 'initializeSlow'. The first note played with the program only calls
+// its 'initialize(out)', then the notes of this program use this instance.
+// A program that is not prepared is initialized by the first note that uses it.
 
 template<typename OUT, typename INST>
 struct Instrument {
@@ -17,17 +35,71 @@ struct Instrument {
   , sample_rate_(sample_rate) {
     instrument->initializeSlow();
     instrument->initialize(out);
+
+    n_programs = static_cast<int>(std::size(instrument->getPrograms()));
+    states = std::make_unique<std::atomic<ProgramState>[]>(n_programs);
+    for(int i=0; i<n_programs; ++i) {
+      states[i].store(ProgramState::NotPrepared, std::memory_order_relaxed);
+    }
+    prepared.resize(n_programs);
+  }
+
+  ~Instrument() {
+    if(worker.joinable()) {
+      {
+        std::lock_guard<std::mutex> l(worker_mutex);
+        stop_worker = true;
+      }
+      worker_cv.notify_one();
+      worker.join();
+    }
   }
   
   void startOneNote() { playOne(); }
   
   void stopOneNote() {}
   
-  void setNotesCount(int n) { while(n > n_notes) { playOne(); } }
+  void setNotesCount(int n) {
+    while(n > n_notes) {
+      if(!playOne()) {
+        break;
+      }
+    }
+  }
   
   void setRandom(bool b) { random = b; }
   void setSeed(int s) { seed = s; }
-  void setProgram(int prog) { program = prog; }
+  // Takes effect for the next note. If the program is being prepared, notes use the previous program
+  // until it is ready (if no note was played yet, notes are not played until it is ready).
+  // If it was not prepared, it is initialized by the next note.
+  void setProgram(int prog) { program.store(prog, std::memory_order_relaxed); }
+
+  // Prepares 'programs' on a background thread. Returns immediately.
+  void preloadPrograms(std::vector<int> const & programs) {
+    {
+      std::lock_guard<std::mutex> l(worker_mutex);
+      for(auto p : programs) {
+        if(p >= 0 && p < n_programs && states[p].load(std::memory_order_relaxed) == ProgramState::NotPrepared) {
+          pending.push_back(p);
+        }
+      }
+      if(!worker.joinable()) {
+        worker = std::thread([this]{ prepareLoop(); });
+      }
+    }
+    worker_cv.notify_one();
+  }
+
+  void preloadAllPrograms() {
+    std::vector<int> all(n_programs);
+    std::iota(all.begin(), all.end(), 0);
+    preloadPrograms(all);
+  }
+
+  // true if switching to this program costs nothing on the note path
+  bool isProgramReady(int prog) const {
+    return prog >= 0 && prog < n_programs && states[prog].load(std::memory_order_acquire) == ProgramState::Ready;
+  }
   void setPan(float p) { pan = p; }
   void setPitch(int16_t p) {
     midiPitch = p;
@@ -54,6 +126,7 @@ struct Instrument {
     return false;
   }
   
+  // use 'isProgramReady' to know if a program has been prepared
   auto const & getPrograms() const { return instrument->getPrograms(); }
 private:
   OUT & out;
@@ -64,18 +137,127 @@ private:
   int seed = 1;
   bool random = false;
   float pan = 0.f;
-  int program = 0;
+  std::atomic<int> program = 0;
   Midi midi;
   int sample_rate_;
-  
-  void playOne() {
+
+  enum class ProgramState : uint8_t {
+    NotPrepared,
+    Preparing, // by the background thread, or by a note
+    Ready
+  };
+
+  int n_programs;
+  std::unique_ptr<std::atomic<ProgramState>[]> states;
+  // the program of the last note
+  int active_program = -1;
+
+  struct PreparedInstance {
+    // written by the background thread before the program is 'Ready'
+    std::unique_ptr<INST> instance;
+    // 'initialize(out)' was called, by the note path
+    bool initialized = false;
+  };
+  // per program, when 'INST' has no 'prepareProgram' method
+  std::vector<PreparedInstance> prepared;
+
+  std::thread worker;
+  std::mutex worker_mutex;
+  std::condition_variable worker_cv;
+  std::deque<int> pending;
+  bool stop_worker = false;
+
+  void prepareLoop() {
+    while(true) {
+      int prog;
+      {
+        std::unique_lock<std::mutex> l(worker_mutex);
+        worker_cv.wait(l, [this]{ return stop_worker || !pending.empty(); });
+        if(stop_worker) {
+          return;
+        }
+        prog = pending.front();
+        pending.pop_front();
+      }
+      if(!claim(prog)) {
+        continue; // already prepared, or initialized by a note
+      }
+      if constexpr (detail::HasPrepareProgram<Inst>::value) {
+        instrument->prepareProgram(prog);
+      }
+      else {
+        auto i = std::make_unique<Inst>();
+        i->initializeSlow();
+        prepared[prog].instance = std::move(i);
+      }
+      states[prog].store(ProgramState::Ready, std::memory_order_release);
+    }
+  }
+
+  bool claim(int prog) {
+    auto expected = ProgramState::NotPrepared;
+    return states[prog].compare_exchange_strong(expected, ProgramState::Preparing, std::memory_order_acq_rel);
+  }
+
+  // Returns the program to use for the next note, and whether the note initializes it,
+  // or nothing if the note should not be played.
+  std::optional<std::pair<int, bool>> programForNote() {
+    auto const requested = program.load(std::memory_order_relaxed);
+    if(requested < 0 || requested >= n_programs) {
+      return {{requested, false}};
+    }
+    auto state = states[requested].load(std::memory_order_acquire);
+    if(state == ProgramState::NotPrepared) {
+      if(claim(requested)) {
+        return {{requested, true}};
+      }
+      // the background thread started preparing it
+      state = states[requested].load(std::memory_order_acquire);
+    }
+    if(state == ProgramState::Ready) {
+      return {{requested, false}};
+    }
+    if(active_program >= 0) {
+      return {{active_program, false}};
+    }
+    // no note was played yet : there is no other program to use.
+    return {};
+  }
+
+  // the instance of 'INST' playing the notes of a program
+  INST & instanceFor(int prog) {
+    if(prog < 0 || prog >= n_programs) {
+      return *instrument;
+    }
+    auto & p = prepared[prog];
+    if(!p.instance) {
+      return *instrument;
+    }
+    if(!p.initialized) {
+      p.instance->initialize(out);
+      p.initialized = true;
+    }
+    return *p.instance;
+  }
+
+  // returns false if the note was not played, see 'programForNote'
+  bool playOne() {
+    auto const note = programForNote();
+    if(!note) {
+      return false;
+    }
+    auto const [prog, initializes] = *note;
     audio::playOneThing(sample_rate_,
                         midi,
-                        *instrument,
+                        instanceFor(prog),
                         out,
-                        audio::Voicing{ program, midiPitch, volume, pan, random, seed},
+                        audio::Voicing{ prog, midiPitch, volume, pan, random, seed},
                         audio::NoteId{n_notes++});
-    
+    if(initializes) {
+      states[prog].store(ProgramState::Ready, std::memory_order_release);
+    }
+    active_program = prog;
+    return true;
   }
 
   typename OUT::ChannelsT::NoXFadeChans *
@@ -0,0 +1,35 @@
+
+namespace imajuscule::audio {
+
+/*
+ * Values that are expensive to compute and only depend on a key (filter tables, ...)
+ * are shared : they are computed once per key, and freed when no one uses them anymore.
+ *
+ * 'get' locks a mutex, and may construct the value : it must not be called from a realtime thread.
+ */
+template<typename Key, typename Value>
+struct SharedCache {
+  template<typename... Args>
+  static std::shared_ptr<Value const> get(Key const & key, Args &&... args) {
+    std::lock_guard<std::mutex> l(mutex());
+    auto & weak = values()[key];
+    if(auto v = weak.lock()) {
+      return v;
+    }
+    auto v = std::make_shared<Value const>(std::forward<Args>(args)...);
+    weak = v;
+    return v;
+  }
+
+private:
+  static std::map<Key, std::weak_ptr<Value const>> & values() {
+    static std::map<Key, std::weak_ptr<Value const>> v;
+    return v;
+  }
+  static std::mutex & mutex() {
+    static std::mutex m;
+    return m;
+  }
+};
+
+}
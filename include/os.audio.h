@@ -19,6 +19,9 @@ namespace imajuscule {
         static Audio * getInstance();
 
         audio::AudioOut & out() { return audioOut; }
+#ifndef NO_AUDIO_IN
+        sensor::AudioIn & in() { return audioIn; }
+#endif
 
     private:
         Audio() = default;
@@ -24,14 +24,18 @@ struct FreqFromZC : public Sensor<FreqFromZC, NO_LOCK, float>
   std::string const & getVarName() { return name; }
   const char * getVarDoc() { return "Audio frequency"; }
   
-  // use constant epsilon instead of 0 to not record zero crossing related to noise
-  static constexpr SAMPLE upperZero =
+  // use epsilon instead of 0 to not record zero crossing related to noise.
+  // This is the value used until the noise has been measured (see SilenceGate).
+  static constexpr SAMPLE defaultUpperZero =
 #ifdef _WIN32
-  0.005f // TODO make that user configurable (ask user to record noise)
+  0.005f
 #else
   0.01f
 #endif
   ;
+
+  void setUpperZero(SAMPLE v) { upperZero = v; }
+  SAMPLE getUpperZero() const { return upperZero; }
   
   InternalResult computeWhileLocked(float & f);
   
@@ -93,6 +97,7 @@ private:
   
   cyclic<int> positive_zeros_dist; // zero crossing intervals are recorded over several time steps
   int32_t acc = 0;
+  SAMPLE upperZero = defaultUpperZero;
   bool bWasNeg : 1;
   
   range<float> signal_range; // range is representative of a single time step (except for very first calculation of a series)
@@ -120,6 +125,12 @@ struct AlgoMax : public Sensor<AlgoMax, NO_LOCK, float>
     val = std::abs(val);
     maxAbsSinceLastRead = std::max(maxAbsSinceLastRead, val);
   }
+
+  // 'maxAbs' is the maximum of the absolute values of a block of samples
+  void feedBlockMax(SAMPLE maxAbs)
+  {
+    maxAbsSinceLastRead = std::max(maxAbsSinceLastRead, maxAbs);
+  }
   
   InternalResult compute(float & f);
   
@@ -129,6 +140,40 @@ private:
 };
 
 
+/*
+ * Block-level energy gate, with hysteresis, used to skip the analysis of silent blocks.
+ *
+ * The thresholds are relative to the noise floor, which follows quieter blocks immediately,
+ * and louder blocks slowly (very slowly while the gate is open, so that a sustained sound
+ * keeps it open for a while, but the gate doesn't stay open forever on noise).
+ * Blocks of digital silence (muted device, ...) say nothing about the noise : they are not measured.
+ */
+struct SilenceGate
+{
+  static constexpr float open_ratio = 4.f; // rms, relative to the noise floor
+  static constexpr float close_ratio = 2.f; // rms, relative to the noise floor
+  static constexpr int hangover_blocks = 16; // blocks below the close threshold before the gate closes
+  static constexpr float noise_floor_rise = 0.02f; // how fast the noise floor follows louder noise, on silent blocks
+  static constexpr float min_noise_floor = 1e-5f;
+  // ratio between the peak and the rms of noise, used to derive the zero-crossing threshold
+  static constexpr float noise_crest_factor = 3.f;
+  static constexpr SAMPLE min_zero_threshold = 0.002f;
+
+  // returns true if the block should be analyzed
+  bool feed(float rms);
+  
+  bool isOpen() const { return open; }
+  float getNoiseFloor() const { return std::max(noise_floor, min_noise_floor); }
+
+  // threshold above which a sample is not considered noise
+  SAMPLE zeroThreshold() const { return std::max(min_zero_threshold, noise_crest_factor * getNoiseFloor()); }
+  
+private:
+  float noise_floor = -1.f; // rms
+  int silent_blocks = 0;
+  bool open = true;
+};
+
 struct paTestData
 {
   static constexpr auto sizeSlidingAverage = 160;
@@ -136,6 +181,7 @@ struct paTestData
   paTestData( int sample_rate, Activator & a ) :
   algo_freq(sample_rate, used)
   , algo_max(used)
+  , spectral(sample_rate, used)
   , avg(sizeSlidingAverage)
   , activator(a)
   {
@@ -146,10 +192,17 @@ struct paTestData
   FreqFromZC algo_freq;
   
   AlgoMax algo_max;
+  
+  SpectralFeatures spectral;
     
 private:
   Activator & activator;
   slidingAverage<float> avg;
+  SilenceGate gate;
+
+  // what is done with the block by 'spectral', once the lock is released
+  enum class SpectralStep { None, Feed, Silence };
+  SpectralStep stepWhileLocked(const SAMPLE * inputBuffer, int nFrames);
   
   std::atomic_flag used = ATOMIC_FLAG_INIT;
 };
@@ -169,6 +222,10 @@ public:
   bool Init();
   void TearDown();
   bool Initialized() const { return bInitialized_; }
+
+  // Opens the device at 'rate', and resamples its input to the rate of the analysis.
+  // Must be called while the input is sleeping.
+  void setDeviceSampleRate(int rate) { device_sample_rate = rate; }
 protected:
   bool do_wakeup() override;
   bool do_sleep() override;
@@ -180,14 +237,21 @@ private:
   , data( sampleRate, *this )
   , bInitialized_(false)
   , sample_rate(sampleRate)
+  , device_sample_rate(sampleRate)
   , min_latency(minLatency)
   {}
   
+  static constexpr int resampling_chunk = 1024;
+
   bool bInitialized_ : 1;
   audio::AudioInput<AudioPlat> audio_input;
-  int sample_rate;
+  int sample_rate; // of the analysis
+  int device_sample_rate;
   double min_latency;
   paTestData data;
+  // used when the rate of the device differs from the rate of the analysis
+  std::optional<audio::Resampler> resampler;
+  std::vector<SAMPLE> resampled;
 };
 
 } // NS sensor
@@ -0,0 +1,222 @@
+
+namespace imajuscule {
+namespace sensor {
+
+// declared NO_LOCK to share Lock between multiple algorithms
+struct AlgoSpectral : public Sensor<AlgoSpectral, NO_LOCK, float>
+{
+  friend class Sensor<AlgoSpectral, NO_LOCK, float>;
+
+  std::string const & getVarName() { return name; }
+  const char * getVarDoc() { return doc.c_str(); }
+
+  // if 'peak' is true, the value read is the max since last read, else it is the last value.
+  AlgoSpectral(std::atomic_flag &a, std::string name, std::string doc, bool peak = false)
+  : Sensor<AlgoSpectral, NO_LOCK, float>(&a)
+  , name(std::move(name))
+  , doc(std::move(doc))
+  , peak(peak)
+  {}
+
+  void feed(float v)
+  {
+    value = peak ? std::max(value, v) : v;
+  }
+
+  InternalResult computeWhileLocked(float & f)
+  {
+    f = value;
+    if(peak) {
+      value = 0.f;
+    }
+    return InternalResult::COMPLETE_SUCCESS;
+  }
+  InternalResult compute(float & f)
+  {
+    Assert(0);
+    return InternalResult::COMPLETE_ERROR;
+  }
+
+private:
+  float value = 0.f;
+  std::string const name;
+  std::string const doc;
+  bool const peak;
+};
+
+/*
+ * Computes spectral features from an overlapped short-time Fourier transform.
+ *
+ * All features are derived from the same frames, so adding a feature
+ * doesn't add a pass over the signal. Nothing is allocated once constructed.
+ *
+ * 'feed' and 'silence' don't touch the sensors, so that the analysis can run without holding
+ * the lock of the sensors : the features are published to the sensors by 'publish'.
+ */
+struct SpectralFeatures
+{
+  static constexpr int frame_size = 1024;
+  static constexpr int hop_size = 256;
+  static constexpr int n_bands = 4;
+  // upper frequencies of the bands, the last band goes up to nyquist
+  static constexpr std::array<float, n_bands-1> band_limits{{250.f, 1000.f, 4000.f}};
+  // an onset is a spectral flux that is 'onset_ratio' times higher than the recent average
+  static constexpr float onset_ratio = 2.f;
+  static constexpr float flux_average_smoothing = 0.1f;
+  // avoids reporting huge onsets in a nearly silent signal
+  static constexpr float min_flux_average = 1.f;
+
+  SpectralFeatures(int sample_rate, std::atomic_flag & used)
+  : sample_rate(sample_rate)
+  , fft(kiss_fftr_alloc(frame_size, 0, nullptr, nullptr))
+  , input(frame_size, 0.f)
+  , window(frame_size)
+  , frame(frame_size)
+  , spectrum(frame_size/2 + 1)
+  , magnitudes(frame_size/2 + 1, 0.f)
+  , prev_magnitudes(frame_size/2 + 1, 0.f)
+  , rms(used, "AUR", "Audio rms")
+  , centroid(used, "AUC", "Audio spectral centroid")
+  , onset(used, "AUO", "Audio onset strength", true)
+  , bands(makeBands(used, std::make_index_sequence<n_bands>()))
+  {
+    Assert(fft);
+    // periodic Hann window
+    for(int i=0; i<frame_size; ++i) {
+      window[i] = 0.5f - 0.5f * static_cast<float>(std::cos(2. * M_PI * i / frame_size));
+    }
+    window_power = 0.f;
+    for(auto w : window) {
+      window_power += w * w;
+    }
+
+    int bin = 0;
+    for(int b=0; b<n_bands; ++b) {
+      int const end = (b == n_bands - 1) ?
+        frame_size/2 + 1 :
+        std::min(frame_size/2 + 1, static_cast<int>(band_limits[b] * frame_size / sample_rate + 0.5f));
+      band_bins[b] = {bin, std::max(bin, end)};
+      bin = band_bins[b].second;
+    }
+  }
+
+  template<typename F>
+  void forEachSensor(F f)
+  {
+    f(rms);
+    f(centroid);
+    f(onset);
+    for(auto & b : bands) {
+      f(b);
+    }
+  }
+
+  void feed(const SAMPLE * buf, int nFrames)
+  {
+    while(nFrames > 0) {
+      auto const n = std::min(nFrames, hop_size - fill);
+      std::copy(buf, buf + n, input.begin() + (frame_size - hop_size + fill));
+      fill += n;
+      buf += n;
+      nFrames -= n;
+      if(fill == hop_size) {
+        analyze();
+        std::copy(input.begin() + hop_size, input.end(), input.begin());
+        fill = 0;
+      }
+    }
+  }
+
+  // to be called when the signal is known to be silent, instead of feeding it.
+  void silence()
+  {
+    std::fill(input.begin(), input.end(), 0.f);
+    std::fill(prev_magnitudes.begin(), prev_magnitudes.end(), 0.f);
+    fill = 0;
+    pending = Features{};
+    pending.valid = true;
+  }
+
+  bool hasPending() const { return pending.valid; }
+
+  // Feeds the sensors with the features computed since the last call.
+  // To be called while holding the lock of the sensors.
+  void publish()
+  {
+    if(!pending.valid) {
+      return;
+    }
+    rms.feed(pending.rms);
+    centroid.feed(pending.centroid);
+    if(pending.onset > 0.f) {
+      onset.feed(pending.onset);
+    }
+    for(int b=0; b<n_bands; ++b) {
+      bands[b].feed(pending.bands[b]);
+    }
+    pending = Features{};
+  }
+
+private:
+  struct KissFFTRDeleter {
+    void operator()(kiss_fftr_cfg cfg) const { kiss_fftr_free(cfg); }
+  };
+
+  // the values of the last frame, except 'onset' which is the max over the frames
+  struct Features {
+    bool valid = false;
+    float rms = 0.f, centroid = 0.f, onset = 0.f;
+    std::array<float, n_bands> bands{};
+  };
+
+  int sample_rate;
+  // the configuration contains scratch buffers, hence it is not shared
+  std::unique_ptr<std::remove_pointer_t<kiss_fftr_cfg>, KissFFTRDeleter> fft;
+  std::vector<float> input; // the last 'frame_size' samples, the last hop being filled
+  std::vector<float> window;
+  float window_power; // sum of the squares of the window
+  std::vector<kiss_fft_scalar> frame;
+  std::vector<kiss_fft_cpx> spectrum;
+  std::vector<float> magnitudes, prev_magnitudes;
+  std::array<std::pair<int, int>, n_bands> band_bins; // [begin, end) bins
+  int fill = 0;
+  float flux_average = 0.f;
+  Features pending;
+
+  AlgoSpectral rms, centroid, onset;
+  std::array<AlgoSpectral, n_bands> bands;
+
+  static std::string frequencyDoc(float hz)
+  {
+    char buf[32];
+    if(hz >= 1000.f) {
+      snprintf(buf, sizeof(buf), "%g kHz", hz / 1000.f);
+    }
+    else {
+      snprintf(buf, sizeof(buf), "%g Hz", hz);
+    }
+    return buf;
+  }
+
+  static std::string bandDoc(int b)
+  {
+    if(b == 0) {
+      return "Audio energy below " + frequencyDoc(band_limits[0]);
+    }
+    if(b == n_bands - 1) {
+      return "Audio energy above " + frequencyDoc(band_limits[b-1]);
+    }
+    return "Audio energy between " + frequencyDoc(band_limits[b-1]) + " and " + frequencyDoc(band_limits[b]);
+  }
+
+  template<size_t... I>
+  static std::array<AlgoSpectral, n_bands> makeBands(std::atomic_flag & used, std::index_sequence<I...>)
+  {
+    return {{ {used, "AUB" + std::to_string(I), bandDoc(I)}... }};
+  }
+
+  void analyze();
+};
+
+} // NS sensor
+} // NS Imajuscule
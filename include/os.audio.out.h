@@ -9,10 +9,70 @@ namespace imajuscule {
     //   - never read the buffer state from a non rt thread (see editInactiveAudioElement) :
     //      it is meaningless, because the state is changed by the audio thread.
 
-    using outputData = outputDataBase<
+    using outputDataBaseT = outputDataBase<
         ChannelsVecAggregate<2, AudioOutPolicy::MasterGlobalLock>,
         ReverbType::Realtime_Synchronous
         >;
+
+    struct AudioOut;
+
+    // A command applied by the render thread at a given frame (see 'AudioOut::playAt', ...)
+    struct TimedCommand {
+        void (*apply)(AudioOut &, TimedCommand const &);
+        AudioOut * target;
+        uint8_t channel;
+        float volume;
+        int nSteps;
+        void * element; // for 'playComputableAt'
+        int payload; // index of the slot holding what doesn't fit here, or -1
+    };
+
+    // Audio mixed into the output by the render thread, after the channels (see 'shm::Server').
+    struct MixSource {
+        virtual ~MixSource() = default;
+        // adds 'nFrames' interleaved frames to 'outputBuffer', at the rate of the channels.
+        virtual void mixInto(SAMPLE * outputBuffer, int nFrames) = 0;
+    };
+
+    // The channel handler of 'AudioOut'.
+    //
+    // 'step' is called by the device callback, and wraps the rendering of the channels:
+    // - the channels are rendered in sub-blocks of at most 64 frames, split at the frames of the timed commands,
+    // so that timed commands are applied at their exact frame whatever the size of the device buffer.
+    // - when the content is rendered at another rate than the rate of the device (see 'AudioOut::setContentSampleRate'),
+    // the channels are rendered in small chunks at the content rate, and resampled on the master bus.
+    struct outputData : public outputDataBaseT {
+        using outputDataBaseT::outputDataBaseT;
+
+        static constexpr int nOutChannels = 2; // see 'outputDataBaseT'
+
+        void step(SAMPLE * outputBuffer, int nFrames);
+
+        // Must not be called while the device is rendering with another resampler.
+        void startResampling(int content_rate, int device_rate);
+        // Must be called once the device is stopped.
+        void stopResampling();
+
+        // count of frames rendered so far, at the rate of the channels
+        std::atomic<uint64_t> const & renderedFrames() const { return timed.frameCounter(); }
+
+        // 'source' is used by the render thread until 'setMixSource' is called with another source.
+        void setMixSource(MixSource * source);
+
+        using TimedCommands = SubBlockRenderer<TimedCommand>;
+        // to schedule timed commands, from a single thread at a time
+        TimedCommands & editTimedCommands() { return timed; }
+
+    private:
+        std::unique_ptr<ResampledRenderer> resampled;
+        // read by the render thread
+        std::atomic<ResampledRenderer*> resampling{nullptr};
+        TimedCommands timed;
+        std::atomic<MixSource*> mix_source{nullptr};
+        std::atomic<bool> mixing{false}; // true while the render thread uses 'mix_source'
+
+        void renderChannels(SAMPLE * outputBuffer, int nFrames);
+    };
     
     struct AudioOut : public NonCopyable {
 
@@ -36,6 +96,7 @@ namespace imajuscule {
         using XFadeInfiniteChans = typename outputData::ChannelsT::XFadeInfiniteChans;
         using Volumes = AudioCtxt::Volumes;
         static constexpr auto atomicity = outputData::ChannelsT::atomicity;
+        using Request = AudioCtxt::Request;
 
         friend class Audio;
 
@@ -44,15 +105,113 @@ namespace imajuscule {
         
         Sounds<atomicity> sounds;
 
+        std::optional<int> content_sample_rate;
+        // true when the channels are rendered at 'content_sample_rate', and resampled to the rate of the device
+        bool resampling = false;
+
+        // Called once the context is initialized, by 'Init' or lazily by 'openChannel'.
+        void startResampling() {
+            auto device_rate = ctxt.getSampleRate();
+            if(resampling || !content_sample_rate || !device_rate || *device_rate == *content_sample_rate) {
+                return;
+            }
+            // the channels have no request yet, so the frames rendered at the rate of the device until now are silent.
+            getChannelHandler().startResampling(*content_sample_rate, *device_rate);
+            resampling = true;
+        }
+
+        std::unique_ptr<CommandRecorder> recorder;
+
+        void record(RecordedCommandType type, uint8_t channel, uint8_t param8 = 0, int32_t param32 = 0, float volume = 0.f) {
+            if(unlikely(recorder)) {
+                recorder->record({0, type, channel, param8, 0, param32, volume});
+            }
+        }
+        void recordAt(uint64_t frame, RecordedCommandType type, uint8_t channel, int32_t param32 = 0, float volume = 0.f) {
+            if(unlikely(recorder)) {
+                recorder->record({frame, type, channel, 0, RecordedCommand::timed, param32, volume});
+            }
+        }
+
+        // What doesn't fit in a 'TimedCommand', in preallocated slots : the render thread only moves
+        // the requests out of a slot, and returns the slot to the scheduling threads, which destroy
+        // what remains in it, so that the render thread doesn't deallocate.
+        struct TimedPayload {
+            std::optional<StackVector<Request>> requests;
+            std::optional<PackedRequestParams<nAudioOut>> params;
+        };
+        static constexpr int n_timed_payloads = outputData::TimedCommands::capacity;
+        std::vector<TimedPayload> timed_payloads;
+        // the slots that can be used, under 'timed_mutex'
+        std::vector<int> free_payloads;
+        // the slots used by the render thread
+        SpscRing<int, n_timed_payloads> released_payloads;
+        // timed commands can be scheduled from several threads
+        std::mutex timed_mutex;
+
+        // 'timed_mutex' must be locked
+        [[nodiscard]] bool scheduleAt(uint64_t frame, TimedCommand c, std::optional<TimedPayload> payload = {}) {
+            while(auto i = released_payloads.tryPop()) {
+                timed_payloads[*i] = {};
+                free_payloads.push_back(*i);
+            }
+            auto & commands = getChannelHandler().editTimedCommands();
+            if(!commands.canSchedule() || (payload && free_payloads.empty())) {
+                LG(ERR, "AudioOut : too many timed commands");
+                return false;
+            }
+            c.payload = -1;
+            if(payload) {
+                c.payload = free_payloads.back();
+                free_payloads.pop_back();
+                timed_payloads[c.payload] = std::move(*payload);
+            }
+            [[maybe_unused]] bool const scheduled = commands.schedule(frame, c);
+            Assert(scheduled);
+            return true;
+        }
+
+        // Called by the render thread, between two sub-blocks.
+        // Like the rendering of a sub-block, the commands take the master lock of the channels,
+        // and the channels append the requests to their queue.
+        static void applyPlay(AudioOut & o, TimedCommand const & c) {
+            auto & p = o.timed_payloads[c.payload];
+            Assert(p.requests);
+            o.ctxt.play(c.channel, std::move(*p.requests));
+            o.releasePayload(c.payload);
+        }
+        static void applyToVolume(AudioOut & o, TimedCommand const & c) {
+            o.ctxt.toVolume(c.channel, c.volume, c.nSteps);
+        }
+        template<typename Algo>
+        static void applyPlayComputable(AudioOut & o, TimedCommand const & c) {
+            auto & p = o.timed_payloads[c.payload];
+            Assert(p.params);
+            if(!o.ctxt.playComputable(*p.params, *static_cast<audioelement::FinalAudioElement<Algo>*>(c.element))) {
+                LG(ERR, "AudioOut : timed playComputable failed");
+            }
+            o.releasePayload(c.payload);
+        }
+        void releasePayload(int i) {
+            // there are as many places as slots
+            [[maybe_unused]] bool const pushed = released_payloads.tryPush(i);
+            Assert(pushed);
+        }
+
     public:
-        using Request = AudioCtxt::Request;
         static constexpr auto nAudioOut = AudioCtxt::nAudioOut;
       
       auto & getChannelHandler() { return ctxt.getChannelHandler(); }
 
       AudioOut()
       : ctxt()
+      , timed_payloads(n_timed_payloads)
       {
+        free_payloads.reserve(n_timed_payloads);
+        for(int i = n_timed_payloads - 1; i >= 0; --i) {
+          free_payloads.push_back(i);
+        }
+
         getChannelHandler().getChannels().getChannelsXFadeInfinite().emplace_front(getChannelHandler().get_lock_policy(),
                                                                                    std::numeric_limits<uint8_t>::max());
         
@@ -67,14 +226,58 @@ namespace imajuscule {
             ctxt.finalize(); // needs to be called before 'Sounds' destructor
         }
       
+      // Returns the rate at which the channels are rendered : the rate of the content if the mix
+      // is resampled (see 'setContentSampleRate'), else the rate of the device.
       std::optional<int> getSampleRate() const {
-        return ctxt.getSampleRate();
+        auto device_rate = ctxt.getSampleRate();
+        if(device_rate && resampling) {
+          return content_sample_rate;
+        }
+        return device_rate;
+      }
+
+      // Renders the channels at 'rate', and resamples the mix to the rate of the device,
+      // so that a single set of assets can be used whatever the rate of the device.
+      // Must be called before the device is initialized, by 'Init' or lazily by 'openChannel'
+      // (see 'Audio::OutInitPolicy::LAZY').
+      void setContentSampleRate(int rate) {
+        Assert(!Initialized());
+        content_sample_rate = rate;
+      }
+
+      // Returns a resampler converting content authored at 'native_rate' to the rate at which the channels are rendered,
+      // or nothing if no conversion is needed or if the device is not initialized yet.
+      std::optional<Resampler> makeResamplerFrom(int native_rate, int nChannels) const {
+        auto render_rate = getSampleRate();
+        if(!render_rate || *render_rate == native_rate) {
+          return {};
+        }
+        return Resampler(native_rate, *render_rate, nChannels);
+      }
+
+      // Converts interleaved content authored at 'native_rate' to the rate at which the channels are rendered,
+      // or returns nothing if the device is not initialized yet.
+      std::optional<std::vector<float>> toRenderRate(std::vector<float> const & interleaved, int nChannels, int native_rate) const {
+        auto render_rate = getSampleRate();
+        if(!render_rate) {
+          LG(ERR, "AudioOut::toRenderRate : device is not initialized");
+          return {};
+        }
+        return Resampler::convert(interleaved, nChannels, native_rate, *render_rate);
       }
       
         [[nodiscard]] bool Init(int sample_rate, float minOutputLatency) {
-          return ctxt.Init(sample_rate, minOutputLatency);
+          if(!ctxt.Init(sample_rate, minOutputLatency)) {
+            return false;
+          }
+          startResampling();
+          return true;
+        }
+        void TearDown() {
+          ctxt.TearDown();
+          getChannelHandler().stopResampling();
+          resampling = false;
         }
-        void TearDown() { ctxt.TearDown(); }
 
         auto & getCtxt() { return ctxt; }
       
@@ -87,27 +290,91 @@ namespace imajuscule {
         uint8_t openChannel(float volume = 1.f,
                             ChannelClosingPolicy p = ChannelClosingPolicy::ExplicitClose,
                             int xfade_length = 401) {
-            return ctxt.openChannel(volume, p, xfade_length);
+            bool const wasInitialized = Initialized();
+            auto const id = ctxt.openChannel(volume, p, xfade_length);
+            if(!wasInitialized && Initialized()) {
+                // the context initialized itself
+                startResampling();
+            }
+            record(RecordedCommandType::OpenChannel, id, static_cast<uint8_t>(p), xfade_length, volume);
+            return id;
         }
 
         bool play( uint8_t channel_id, StackVector<Request> && v ) {
+            record(RecordedCommandType::Play, channel_id, 0, static_cast<int32_t>(v.size()));
             return ctxt.play(channel_id, std::move(v));
         }
 
         template<typename Algo>
         [[nodiscard]] bool playComputable(PackedRequestParams<nAudioOut> params,
                                           audioelement::FinalAudioElement<Algo> & e) {
+          record(RecordedCommandType::PlayComputable, std::numeric_limits<uint8_t>::max());
           return ctxt.playComputable(params, e);
         }
 
         void toVolume( uint8_t channel_id, float volume, int nSteps ) {
+            record(RecordedCommandType::ToVolume, channel_id, 0, nSteps, volume);
             ctxt.toVolume( channel_id, volume, nSteps);
         }
 
+        // Frame-stamped variants of 'play', 'playComputable' and 'toVolume' : the command is applied by the render thread
+        // when 'frame' (see 'getRenderedFrames') is rendered, whatever the size of the device buffer.
+        // A frame that is already rendered is applied at the next sub-block of 64 frames.
+        // Returns false if too many timed commands are pending.
+        [[nodiscard]] bool playAt(uint64_t frame, uint8_t channel_id, StackVector<Request> && v) {
+            std::lock_guard<std::mutex> l(timed_mutex);
+            recordAt(frame, RecordedCommandType::Play, channel_id, static_cast<int32_t>(v.size()));
+            return scheduleAt(frame, {&applyPlay, this, channel_id, 0.f, 0, nullptr, -1}, TimedPayload{std::move(v), {}});
+        }
+
+        template<typename Algo>
+        [[nodiscard]] bool playComputableAt(uint64_t frame,
+                                            PackedRequestParams<nAudioOut> params,
+                                            audioelement::FinalAudioElement<Algo> & e) {
+            std::lock_guard<std::mutex> l(timed_mutex);
+            recordAt(frame, RecordedCommandType::PlayComputable, std::numeric_limits<uint8_t>::max());
+            return scheduleAt(frame, {&applyPlayComputable<Algo>, this, 0, 0.f, 0, &e, -1}, TimedPayload{{}, params});
+        }
+
+        [[nodiscard]] bool toVolumeAt(uint64_t frame, uint8_t channel_id, float volume, int nSteps) {
+            std::lock_guard<std::mutex> l(timed_mutex);
+            recordAt(frame, RecordedCommandType::ToVolume, channel_id, nSteps, volume);
+            return scheduleAt(frame, {&applyToVolume, this, channel_id, volume, nSteps, nullptr, -1});
+        }
+
         void closeChannel(uint8_t channel_id, CloseMode mode) {
+            record(RecordedCommandType::CloseChannel, channel_id, static_cast<uint8_t>(mode));
             ctxt.closeChannel( channel_id, mode );
         }
 
+        // Count of frames rendered so far, at the rate of the channels (see 'getSampleRate').
+        uint64_t getRenderedFrames() {
+            return getChannelHandler().renderedFrames().load(std::memory_order_acquire);
+        }
+
+        // Renders the channels into 'outputBuffer' ('nFrames' interleaved frames) from the calling thread,
+        // to replay commands (see 'AudioOutReplayTarget') or to render without a device.
+        // Returns false if the device is initialized, because its callback would render concurrently.
+        [[nodiscard]] bool renderOffline(SAMPLE * outputBuffer, int nFrames);
+
+        // Starts recording the commands, so that they can be replayed offline (see 'replay').
+        // Recording must not be started or stopped while commands are issued from other threads.
+        void startRecording() {
+            recorder = std::make_unique<CommandRecorder>(getSampleRate().value_or(AudioCtxt::lazySamplingRate),
+                                                         getChannelHandler().renderedFrames());
+        }
+
+        // Stops recording, and saves the commands to 'path'.
+        [[nodiscard]] bool stopRecording(std::string const & path) {
+            if(!recorder) {
+                LG(ERR, "AudioOut::stopRecording : not recording");
+                return false;
+            }
+            bool const res = recorder->save(path);
+            recorder.reset();
+            return res;
+        }
+
         Sounds<atomicity> & editSounds() { return sounds; }
 
     };
@@ -0,0 +1,245 @@
+
+namespace imajuscule::audio {
+
+enum class RecordedCommandType : uint8_t {
+  OpenChannel,
+  Play,
+  PlayComputable,
+  ToVolume,
+  CloseChannel
+};
+
+// A command issued to 'AudioOut', timestamped in frames since the beginning of the recording.
+// Serialized as 24 bytes, in the byte order of the recording machine.
+struct RecordedCommand {
+  uint64_t frame;
+  RecordedCommandType type;
+  uint8_t channel; // for OpenChannel, the id of the channel that was opened
+  uint8_t param8; // ChannelClosingPolicy / CloseMode
+  uint8_t flags = 0;
+  int32_t param32; // xfade length / count of requests / volume steps
+  float volume;
+  int32_t reserved = 0;
+
+  // the command was issued with a frame stamp (see 'AudioOut::playAt', ...), which is 'frame'.
+  static constexpr uint8_t timed = 1;
+};
+static_assert(sizeof(RecordedCommand) == 24);
+static_assert(std::is_trivially_copyable_v<RecordedCommand>);
+
+/*
+ * Records the commands issued to 'AudioOut', to reproduce timing-dependent issues offline.
+ *
+ * The timestamp of a command is the number of frames that were rendered by the device callback
+ * (at the rate of the channels) between the start of the recording and the command.
+ * The content of the requests is not recorded : see 'AudioOutReplayTarget'.
+ */
+struct CommandRecorder {
+  static constexpr std::array<char, 4> magic{{'O','S','A','R'}};
+  static constexpr uint32_t version = 1;
+
+  // 'rendered_frames' is the count of frames rendered so far, written by the render thread.
+  CommandRecorder(int sample_rate, std::atomic<uint64_t> const & rendered_frames)
+  : sample_rate(sample_rate)
+  , rendered_frames(rendered_frames)
+  , start(rendered_frames.load(std::memory_order_acquire))
+  {
+    commands.reserve(4096);
+  }
+
+  int getSampleRate() const { return sample_rate; }
+
+  // the frame of a timed command is its frame stamp, else it is the count of frames rendered so far.
+  void record(RecordedCommand c) {
+    std::lock_guard<std::mutex> l(mutex);
+    if(c.flags & RecordedCommand::timed) {
+      c.frame = (c.frame > start) ? (c.frame - start) : 0;
+    }
+    else {
+      // read under the lock so that the commands are sorted
+      c.frame = rendered_frames.load(std::memory_order_acquire) - start;
+    }
+    commands.push_back(c);
+  }
+
+  [[nodiscard]] bool save(std::string const & path) const {
+    std::ofstream f(path, std::ios::binary);
+    if(!f) {
+      LG(ERR, "CommandRecorder::save : cannot open '%s'", path.c_str());
+      return false;
+    }
+    std::vector<RecordedCommand> sorted;
+    {
+      std::lock_guard<std::mutex> l(mutex);
+      sorted = commands;
+    }
+    // timed commands are usually issued before their frame
+    std::stable_sort(sorted.begin(), sorted.end(), [](auto const & a, auto const & b) {
+      return a.frame < b.frame;
+    });
+    uint32_t const header[] = { version, static_cast<uint32_t>(sample_rate) };
+    f.write(magic.data(), magic.size());
+    f.write(reinterpret_cast<const char*>(header), sizeof(header));
+    f.write(reinterpret_cast<const char*>(sorted.data()), sorted.size() * sizeof(RecordedCommand));
+    return static_cast<bool>(f);
+  }
+
+  // returns the sample rate of the recording, and the commands
+  static std::optional<std::pair<int, std::vector<RecordedCommand>>> load(std::string const & path) {
+    std::ifstream f(path, std::ios::binary);
+    std::array<char, 4> m;
+    uint32_t header[2];
+    if(!f.read(m.data(), m.size()) || m != magic ||
+       !f.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != version) {
+      LG(ERR, "CommandRecorder::load : '%s' is not a command log", path.c_str());
+      return {};
+    }
+    std::vector<RecordedCommand> v;
+    RecordedCommand c;
+    while(f.read(reinterpret_cast<char*>(&c), sizeof(c))) {
+      v.push_back(c);
+    }
+    return std::make_pair(static_cast<int>(header[1]), std::move(v));
+  }
+
+private:
+  int sample_rate;
+  std::atomic<uint64_t> const & rendered_frames;
+  uint64_t const start;
+  mutable std::mutex mutex;
+  std::vector<RecordedCommand> commands;
+};
+
+/*
+ * Replays recorded commands on a virtual device, block by block, as fast as possible.
+ *
+ * 'Target' must have:
+ *   void onCommand(RecordedCommand const &);
+ *   bool render(int nFrames); // renders the next 'nFrames' frames of the virtual device, returns false on error
+ *
+ * Commands are applied before the block containing their frame is rendered, like commands
+ * issued between two device callbacks, hence the result only depends on the log and on the block size.
+ * Timed commands are scheduled at their frame, so they are applied at this exact frame during the block.
+ *
+ * Blocks are rendered until every command is applied, and at least 'nFrames' frames are rendered,
+ * so that what follows the last command (a fade, the end of a sound...) can be rendered too.
+ * Returns false if the target failed to render a block.
+ */
+template<typename Target>
+[[nodiscard]] bool replay(std::vector<RecordedCommand> const & commands, int blockSize, Target & target,
+                          uint64_t nFrames = 0) {
+  Assert(blockSize > 0);
+  Assert(std::is_sorted(commands.begin(), commands.end(), [](auto const & a, auto const & b) {
+    return a.frame < b.frame;
+  }));
+  uint64_t frame = 0;
+  auto it = commands.begin();
+  auto const end = commands.end();
+  while(it != end || frame < nFrames) {
+    uint64_t const blockEnd = frame + blockSize;
+    for(; it != end && it->frame < blockEnd; ++it) {
+      target.onCommand(*it);
+    }
+    if(!target.render(blockSize)) {
+      return false;
+    }
+    frame = blockEnd;
+  }
+  return true;
+}
+
+/*
+ * Replay target forwarding the commands to an 'AudioOut', and rendering it with 'renderOffline'
+ * (or with a user-provided function).
+ *
+ * The content of the requests is not recorded (it references sounds and algorithms
+ * that only exist in the recording process), so 'play' and 'playComputable' commands
+ * are forwarded to user-provided functions, which receive the channel id in the replay.
+ * They are called before the block containing the frame of the command, even for timed commands.
+ */
+template<typename OUT>
+struct AudioOutReplayTarget {
+  using PlayF = std::function<void(OUT &, uint8_t channel_id, int nRequests)>;
+  using PlayComputableF = std::function<void(OUT &)>;
+  // receives the frames rendered by the virtual device
+  using SinkF = std::function<void(SAMPLE const * interleaved, int nFrames)>;
+
+  AudioOutReplayTarget(OUT & out, PlayF play = {}, PlayComputableF playComputable = {}, SinkF sink = {})
+  : out(out)
+  , first_frame(out.getRenderedFrames())
+  , playF(std::move(play))
+  , playComputableF(std::move(playComputable))
+  , sinkF(std::move(sink))
+  {}
+
+  void onCommand(RecordedCommand const & c) {
+    switch(c.type) {
+      case RecordedCommandType::OpenChannel:
+        channels[c.channel] = out.openChannel(c.volume,
+                                              static_cast<ChannelClosingPolicy>(c.param8),
+                                              c.param32);
+        break;
+      case RecordedCommandType::Play:
+        if(auto id = channel(c.channel); id && playF) {
+          playF(out, *id, c.param32);
+        }
+        break;
+      case RecordedCommandType::PlayComputable:
+        if(playComputableF) {
+          playComputableF(out);
+        }
+        break;
+      case RecordedCommandType::ToVolume:
+        if(auto id = channel(c.channel)) {
+          if(c.flags & RecordedCommand::timed) {
+            if(!out.toVolumeAt(first_frame + c.frame, *id, c.volume, c.param32)) {
+              LG(WARN, "AudioOutReplayTarget : timed command dropped");
+            }
+          }
+          else {
+            out.toVolume(*id, c.volume, c.param32);
+          }
+        }
+        break;
+      case RecordedCommandType::CloseChannel:
+        if(auto id = channel(c.channel)) {
+          out.closeChannel(*id, static_cast<CloseMode>(c.param8));
+          channels.erase(c.channel);
+        }
+        break;
+    }
+  }
+
+  // fails if the device of 'out' is initialized (for example by 'openChannel', see 'Audio::OutInitPolicy::LAZY')
+  [[nodiscard]] bool render(int nFrames) {
+    buffer.resize(static_cast<size_t>(nFrames) * OUT::nAudioOut);
+    if(!out.renderOffline(buffer.data(), nFrames)) {
+      return false;
+    }
+    if(sinkF) {
+      sinkF(buffer.data(), nFrames);
+    }
+    return true;
+  }
+
+private:
+  OUT & out;
+  uint64_t const first_frame;
+  PlayF playF;
+  PlayComputableF playComputableF;
+  SinkF sinkF;
+  std::vector<SAMPLE> buffer;
+  // recorded channel id -> channel id in the replay
+  std::map<uint8_t, uint8_t> channels;
+
+  std::optional<uint8_t> channel(uint8_t recorded) const {
+    auto it = channels.find(recorded);
+    if(it == channels.end()) {
+      LG(WARN, "AudioOutReplayTarget : unknown channel %d", recorded);
+      return {};
+    }
+    return it->second;
+  }
+};
+
+}
@@ -0,0 +1,152 @@
+
+namespace imajuscule::audio {
+
+// Polyphase windowed-sinc filter, designed for a rational rate ratio up / down
+// (the ratio between the source and destination sample rates, reduced by their gcd).
+//
+// Coefficients are stored phase by phase, in reverse order, so that computing an
+// output sample is a contiguous dot product with the most recent input samples.
+struct PolyphaseFilter {
+  static constexpr int default_taps_per_phase = 32;
+  static constexpr float kaiser_beta = 8.f;
+  static constexpr float rolloff = 0.95f;
+
+  PolyphaseFilter(int up, int down, int taps_per_phase);
+
+  float const * phaseCoefficients(int phase) const {
+    Assert(phase >= 0 && phase < up);
+    return &coeffs[phase * taps];
+  }
+
+  int const up, down, taps;
+
+private:
+  std::vector<float> coeffs;
+
+  static double besselI0(double x);
+};
+
+// Filters are expensive to design and identical for a given rate ratio,
+// hence they are shared between all resamplers using the same ratio.
+std::shared_ptr<PolyphaseFilter const> getPolyphaseFilter(int from_rate, int to_rate,
+                                                          int taps_per_phase = PolyphaseFilter::default_taps_per_phase);
+
+/*
+ * Streaming sample rate converter for interleaved frames.
+ *
+ * Construction allocates, 'feed' doesn't : it can be used in a realtime thread,
+ * either per channel (nChannels = 1) or on the master bus.
+ */
+struct Resampler {
+  Resampler(int from_rate, int to_rate, int nChannels, int max_frames_per_chunk = 1024)
+  : from_rate(from_rate)
+  , to_rate(to_rate)
+  , n_channels(nChannels)
+  , chunk(max_frames_per_chunk)
+  , filter(getPolyphaseFilter(from_rate, to_rate))
+  , history(nChannels)
+  {
+    Assert(nChannels > 0);
+    Assert(max_frames_per_chunk > 0);
+    for(auto & h : history) {
+      h.reserve(filter->taps + chunk);
+      h.resize(latency() - 1, 0.f);
+    }
+  }
+
+  int getSourceRate() const { return from_rate; }
+  int getDestinationRate() const { return to_rate; }
+  int countChannels() const { return n_channels; }
+
+  // delay of the filter, in source frames : the first frame is produced once 'latency() + 1' source frames
+  // have been fed. It corresponds to the first source frame : the resampler is phase-aligned.
+  int latency() const { return filter->taps / 2; }
+
+  // upper bound of the number of frames produced by 'feed' for 'nFrames' source frames.
+  int maxOutputFrames(int nFrames) const {
+    return static_cast<int>((static_cast<int64_t>(nFrames) * filter->up) / filter->down) + 1;
+  }
+
+  // 'in' and 'out' are interleaved, 'out' must have room for 'maxOutputFrames(nFrames)' frames.
+  // returns the number of frames written to 'out'.
+  int feed(float const * in, int nFrames, float * out) {
+    int produced = 0;
+    while(nFrames > 0) {
+      auto const n = std::min(nFrames, chunk);
+      produced += feedChunk(in, n, out + produced * n_channels);
+      in += n * n_channels;
+      nFrames -= n;
+    }
+    return produced;
+  }
+
+  void reset() {
+    for(auto & h : history) {
+      h.clear();
+      h.resize(latency() - 1, 0.f);
+    }
+    phase = 0;
+    offset = 0;
+  }
+
+  // Converts a whole interleaved buffer, typically when loading content authored at another rate.
+  static std::vector<float> convert(std::vector<float> const & in, int nChannels, int from_rate, int to_rate);
+
+private:
+  int from_rate, to_rate, n_channels, chunk;
+  std::shared_ptr<PolyphaseFilter const> filter;
+  // per channel, the source samples that will be used to compute the next frames
+  std::vector<std::vector<float>> history;
+  int phase = 0;
+  // index in 'history' of the oldest sample used to compute the next output sample
+  int offset = 0;
+
+  int feedChunk(float const * in, int nFrames, float * out);
+
+  static float dot(float const * a, float const * b, int n);
+};
+
+/*
+ * Renders a stream at a source rate, in chunks of 'chunk_frames' frames, and resamples it
+ * to the destination rate, for any count of destination frames.
+ *
+ * Nothing is allocated once constructed, so 'render' can be called from the realtime thread.
+ */
+struct ResampledRenderer {
+  static constexpr int chunk_frames = 64;
+
+  ResampledRenderer(int from_rate, int to_rate, int nChannels)
+  : resampler(from_rate, to_rate, nChannels, chunk_frames)
+  , source(static_cast<size_t>(chunk_frames) * nChannels)
+  , resampled(static_cast<size_t>(resampler.maxOutputFrames(chunk_frames)) * nChannels)
+  {}
+
+  // 'renderSource' is called with (interleaved buffer, count of source frames).
+  template<typename Render>
+  void render(float * out, int nFrames, Render && renderSource) {
+    auto const nChannels = resampler.countChannels();
+    while(nFrames > 0) {
+      if(available == 0) {
+        renderSource(source.data(), chunk_frames);
+        available = resampler.feed(source.data(), chunk_frames, resampled.data());
+        read = 0;
+        continue;
+      }
+      auto const n = std::min(nFrames, available);
+      auto const from = resampled.begin() + read * nChannels;
+      std::copy(from, from + n * nChannels, out);
+      out += n * nChannels;
+      nFrames -= n;
+      read += n;
+      available -= n;
+    }
+  }
+
+private:
+  Resampler resampler;
+  std::vector<float> source, resampled;
+  // frames of 'resampled' that have not been rendered yet
+  int read = 0, available = 0;
+};
+
+}
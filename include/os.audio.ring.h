@@ -0,0 +1,72 @@
+
+namespace imajuscule::audio {
+
+/*
+ * Lock-free ring buffer of capacity 'N', for a single producer thread and a single consumer thread.
+ *
+ * Elements are stored in place : nothing is allocated, and when 'T' is trivially copyable
+ * the ring can be placed in memory shared between processes.
+ */
+template<typename T, int N>
+struct SpscRing {
+  static_assert(N > 0 && (N & (N-1)) == 0, "N must be a power of two");
+  static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+  static constexpr int capacity = N;
+
+  SpscRing() = default;
+  SpscRing(SpscRing const &) = delete;
+  SpscRing & operator=(SpscRing const &) = delete;
+
+  ~SpscRing() {
+    reset();
+  }
+
+  // to be called by the producer thread.
+  // returns false if the ring is full.
+  [[nodiscard]] bool tryPush(T v) {
+    auto const w = write.load(std::memory_order_relaxed);
+    if(w - read.load(std::memory_order_acquire) == static_cast<uint32_t>(N)) {
+      return false;
+    }
+    new (slot(w)) T(std::move(v));
+    write.store(w + 1, std::memory_order_release);
+    return true;
+  }
+
+  // to be called by the consumer thread.
+  std::optional<T> tryPop() {
+    auto const r = read.load(std::memory_order_relaxed);
+    if(r == write.load(std::memory_order_acquire)) {
+      return {};
+    }
+    T * p = slot(r);
+    std::optional<T> res(std::move(*p));
+    p->~T();
+    read.store(r + 1, std::memory_order_release);
+    return res;
+  }
+
+  // empties the ring : neither the producer nor the consumer must be using it.
+  void reset() {
+    while(tryPop()) {
+    }
+  }
+
+  // the result is exact only when called by the consumer thread.
+  int sizeApprox() const {
+    return static_cast<int>(write.load(std::memory_order_acquire) - read.load(std::memory_order_acquire));
+  }
+
+private:
+  // on different cache lines to avoid false sharing between the producer and the consumer.
+  alignas(64) std::atomic<uint32_t> write{0};
+  alignas(64) std::atomic<uint32_t> read{0};
+  alignas(T) unsigned char items[N][sizeof(T)];
+
+  T * slot(uint32_t i) {
+    return reinterpret_cast<T*>(items[i & (N-1)]);
+  }
+};
+
+}
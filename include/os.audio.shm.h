@@ -0,0 +1,185 @@
+
+namespace imajuscule::audio::shm {
+
+/*
+ * Lets local processes use the 'AudioOut' of another process (the server),
+ * instead of each of them opening the device.
+ *
+ * The server creates a named shared memory segment with 'n_slots' client slots.
+ * Each client claims a slot, and communicates with the server through:
+ * - a ring of command descriptors (client -> server),
+ * - a ring of replies (server -> client),
+ * - a pool of PCM blocks, written in place by the client, and mixed from the shared memory
+ *   by the render thread of the server (zero-copy), at the rate of the channels of the server,
+ * with futex wakeups in both directions.
+ *
+ * The server holds an exclusive 'flock' on the segment while it runs, so that a single server
+ * uses a name, and a segment left by a crashed server can be replaced.
+ *
+ * Linux only.
+ */
+
+constexpr uint32_t magic = 0x4f534148; // 'OSAH'
+constexpr uint32_t version = 3;
+
+constexpr int n_slots = 16;
+constexpr int n_commands = 256; // per slot, must be a power of two
+constexpr int n_replies = 64; // per slot, must be a power of two
+constexpr int n_blocks = 32; // per slot
+constexpr int n_block_frames = 1024;
+constexpr int n_block_channels = 2;
+constexpr int max_xfade_length = 1 << 16;
+
+enum class CommandType : uint8_t {
+  OpenChannel,
+  ToVolume,
+  CloseChannel,
+  PlayBlock
+};
+
+struct Command {
+  uint32_t seq;
+  CommandType type;
+  uint8_t channel;
+  uint8_t param8; // ChannelClosingPolicy / CloseMode
+  uint8_t unused = 0;
+  int32_t param32; // xfade length / volume steps / count of frames in the block
+  float volume;
+  int32_t block;
+};
+
+// reply to OpenChannel when no channel could be opened
+constexpr int32_t no_channel = -1;
+
+struct Reply {
+  uint32_t seq;
+  int32_t result;
+};
+
+static_assert(std::is_trivially_copyable_v<Command>);
+static_assert(std::is_trivially_copyable_v<Reply>);
+
+enum BlockState : uint32_t {
+  BlockFree,
+  BlockWritten, // the client is writing the block
+  BlockSubmitted // the server owns the block until it is played
+};
+
+// A client claims a free slot by setting 'owner' to its pid, then initializes the slot and sets 'ready'.
+// If the owner dies (even before 'ready' is set), the server frees the slot.
+struct Slot {
+  std::atomic<int32_t> owner{0};
+  std::atomic<uint32_t> ready{0};
+  std::atomic<uint32_t> released{0}; // the client is gone, the server will free the slot
+  std::atomic<uint32_t> reply_doorbell{0};
+  SpscRing<Command, n_commands> commands;
+  SpscRing<Reply, n_replies> replies;
+  std::atomic<uint32_t> block_states[n_blocks];
+  alignas(64) float blocks[n_blocks][n_block_frames * n_block_channels];
+};
+
+struct Segment {
+  std::atomic<uint32_t> magic{0};
+  uint32_t version;
+  std::atomic<int32_t> server_pid{0};
+  // the rate of the channels of the server, at which the blocks are played
+  std::atomic<int32_t> sample_rate{0};
+  std::atomic<uint32_t> doorbell{0}; // incremented by clients when they push a command
+  Slot slots[n_slots];
+};
+
+class Server : public MixSource, public NonCopyable {
+public:
+  // Fails (see 'valid') if a server with this name is running.
+  Server(AudioOut & out, std::string name);
+  ~Server();
+
+  bool valid() const { return segment != nullptr; }
+
+  // Processes the pending commands of all clients, or waits at most 'timeout' for commands.
+  // Returns the number of commands processed.
+  int process(std::chrono::milliseconds timeout);
+
+  // called by the render thread of 'out'
+  void mixInto(SAMPLE * outputBuffer, int nFrames) override;
+
+private:
+  static constexpr int n_channel_ids = std::numeric_limits<uint8_t>::max() + 1;
+
+  // sent by the server thread to the render thread, for a channel
+  struct StreamEntry {
+    enum Kind : uint8_t { Open, Volume, Block } kind;
+    uint8_t slot;
+    int16_t block;
+    int32_t n; // frames in the block / volume steps
+    float volume;
+  };
+
+  // the PCM of a channel, mixed by the render thread
+  struct Stream {
+    SpscRing<StreamEntry, 64> entries;
+    // used by the render thread only
+    std::optional<StreamEntry> current; // block being played
+    int position = 0;
+    float volume = 1.f, volume_increment = 0.f;
+    int volume_steps = 0;
+  };
+
+  enum class SlotPhase {
+    Unused,
+    Used,
+    Draining // the client is gone, waiting for its blocks to be played
+  };
+
+  AudioOut & out;
+  std::string name;
+  int fd = -1; // locked while the server runs
+  Segment * segment = nullptr;
+  std::array<std::vector<uint8_t>, n_slots> channels; // channels opened by the client of each slot
+  std::array<SlotPhase, n_slots> phases{};
+  // count of blocks of each slot owned by the render thread
+  std::array<std::atomic<int>, n_slots> blocks_in_flight{};
+  std::unique_ptr<std::array<Stream, n_channel_ids>> streams;
+
+  bool lockName();
+  void publishSampleRate();
+  int processSlot(int i);
+  void execute(int i, Command const & c);
+  void releaseSlot(int i);
+  bool owns(int i, uint8_t channel) const;
+  bool pushEntry(uint8_t channel, StreamEntry const & e);
+  void freeBlock(StreamEntry const & e);
+};
+
+class Client : public NonCopyable {
+public:
+  explicit Client(std::string const & name);
+  ~Client();
+
+  bool connected() const { return slot != nullptr; }
+
+  // the rate at which the server plays the blocks
+  int sampleRate() const { return segment ? segment->sample_rate.load(std::memory_order_relaxed) : 0; }
+
+  // returns the id of the channel, or nothing if the server didn't reply within 'timeout'.
+  std::optional<uint8_t> openChannel(float volume = 1.f,
+                                     ChannelClosingPolicy p = ChannelClosingPolicy::ExplicitClose,
+                                     int xfade_length = 401,
+                                     std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+  [[nodiscard]] bool toVolume(uint8_t channel_id, float volume, int nSteps);
+  [[nodiscard]] bool closeChannel(uint8_t channel_id, CloseMode mode);
+
+  // Returns a block of 'n_block_frames' interleaved frames to write into, or nullptr if none is available.
+  float * acquireBlock(int & index);
+  // Plays the first 'nFrames' frames of the block on the channel. The block is owned by the server until played.
+  [[nodiscard]] bool submitBlock(uint8_t channel_id, int index, int nFrames);
+
+private:
+  Segment * segment = nullptr;
+  Slot * slot = nullptr;
+  uint32_t seq = 0;
+
+  [[nodiscard]] bool send(Command c);
+};
+
+}
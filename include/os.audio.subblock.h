@@ -0,0 +1,111 @@
+
+namespace imajuscule::audio {
+
+/*
+ * Renders device blocks of any size as a sequence of fixed-size sub-blocks,
+ * and applies timestamped events at their exact frame.
+ *
+ * Events are scheduled lock-free, from a single producer thread, in any order : the render thread
+ * moves them to a fixed-capacity buffer sorted by frame (events of the same frame are applied
+ * in the order they were scheduled). An event scheduled for a frame that has already been rendered
+ * is applied at the beginning of the next sub-block.
+ *
+ * 'renderSubBlock' is called with (frame offset in the device block, number of frames),
+ * 'applyEvent' is called with the event.
+ */
+template<typename Event, int SubBlockSize = 64, int Capacity = 1024>
+struct SubBlockRenderer {
+  static_assert(SubBlockSize > 0);
+  static constexpr int sub_block_size = SubBlockSize;
+  static constexpr int capacity = Capacity;
+
+  // to be called by the producer thread
+  [[nodiscard]] bool schedule(uint64_t f, Event e) {
+    if(!canSchedule()) {
+      return false;
+    }
+    [[maybe_unused]] bool const pushed = events.tryPush({f, std::move(e)});
+    Assert(pushed);
+    return true;
+  }
+
+  // to be called by the producer thread : true if 'schedule' will succeed
+  bool canSchedule() const {
+    // the events that are not applied yet fit in 'pending'
+    return events.sizeApprox() + n_pending.load(std::memory_order_acquire) < capacity;
+  }
+
+  // to be called by the render thread
+  template<typename Render, typename Apply>
+  void render(int nFrames, Render && renderSubBlock, Apply && applyEvent) {
+    auto const first = frame.load(std::memory_order_relaxed);
+    int offset = 0;
+    while(offset < nFrames) {
+      int n = std::min(sub_block_size, nFrames - offset);
+      uint64_t const start = first + offset;
+
+      receiveEvents();
+      // apply the events that are due, and stop the sub-block before the next one.
+      while(head != tail) {
+        auto & e = pending[head];
+        if(e.first > start) {
+          n = static_cast<int>(std::min<uint64_t>(n, e.first - start));
+          break;
+        }
+        applyEvent(e.second);
+        ++head;
+      }
+      n_pending.store(tail - head, std::memory_order_release);
+
+      renderSubBlock(offset, n);
+      offset += n;
+    }
+    frame.store(first + nFrames, std::memory_order_release);
+  }
+
+  // frames rendered so far
+  uint64_t getFrame() const { return frame.load(std::memory_order_acquire); }
+  std::atomic<uint64_t> const & frameCounter() const { return frame; }
+
+private:
+  using FramedEvent = std::pair<uint64_t, Event>;
+
+  SpscRing<FramedEvent, Capacity> events;
+  // written by the render thread only
+  std::atomic<uint64_t> frame{0};
+  std::atomic<int> n_pending{0};
+
+  // used by the render thread only : the events popped from 'events' but not applied yet,
+  // in [head, tail), sorted by frame.
+  std::array<FramedEvent, Capacity> pending{};
+  int head = 0, tail = 0;
+
+  void receiveEvents() {
+    auto const incoming = events.sizeApprox(); // exact, for the consumer
+    if(!incoming) {
+      return;
+    }
+    // counted before they are popped, so that 'canSchedule' never under-estimates
+    n_pending.store(tail - head + incoming, std::memory_order_release);
+    for(int k = 0; k < incoming; ++k) {
+      auto e = events.tryPop();
+      Assert(e);
+      if(tail == Capacity) {
+        // 'canSchedule' guarantees that all events fit
+        Assert(head > 0);
+        std::move(pending.begin() + head, pending.begin() + tail, pending.begin());
+        tail -= head;
+        head = 0;
+      }
+      // events are usually scheduled in order, so this rarely moves events.
+      int i = tail;
+      for(; i > head && pending[i-1].first > e->first; --i) {
+        pending[i] = std::move(pending[i-1]);
+      }
+      pending[i] = std::move(*e);
+      ++tail;
+    }
+  }
+};
+
+}
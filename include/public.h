@@ -1,15 +1,32 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <optional>
 #include <queue>
+#include <string>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #ifndef NO_AUDIO_IN
 # include "../../tp.muparser/include/public.h"
 # include "../../cg.math/include/public.h"
+# include "kiss_fftr.h"
 #endif
 
 #include "../../cpp.model/include/public.h"
@@ -19,9 +36,19 @@
 # import <AudioToolbox/AUComponent.h>
 #endif
 
+#include "os.audio.cache.h"
+#include "os.audio.ring.h"
+#include "os.audio.resample.h"
+#include "os.audio.replay.h"
+#include "os.audio.subblock.h"
 #include "os.audio.out.h"
 
+#ifdef __linux__
+# include "os.audio.shm.h"
+#endif
+
 #ifndef NO_AUDIO_IN
+# include "os.audio.in.spectral.h"
 # include "os.audio.in.h"
 #endif
 
@@ -1,3 +1,4 @@
+#include "private.h"
 
 using namespace imajuscule;
 
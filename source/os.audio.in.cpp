@@ -1,30 +1,162 @@
+#include "private.h"
 
 using namespace imajuscule;
 using namespace imajuscule::sensor;
 
 void paTestData::step(const SAMPLE *rptr, int nFrames)
 {
-    LockGuard l(used);
-    
+    SpectralStep spectralStep;
+    {
+        LockGuard l(used);
+        spectralStep = stepWhileLocked(rptr, nFrames);
+    }
+
+    // the spectral analysis is done without holding the lock, so that reading the sensors doesn't wait for the FFTs.
+    switch(spectralStep) {
+        case SpectralStep::Feed:
+            spectral.feed(rptr, nFrames);
+            break;
+        case SpectralStep::Silence:
+            spectral.silence();
+            break;
+        case SpectralStep::None:
+            break;
+    }
+    if(spectral.hasPending()) {
+        LockGuard l(used);
+        spectral.publish();
+    }
+}
+
+paTestData::SpectralStep paTestData::stepWhileLocked(const SAMPLE *rptr, int nFrames)
+{
     if( !activator.onStep() && rptr )
     {
+        // cheap pass to know if the block is silent
+        SAMPLE maxAbs = 0.f;
+        float sumSquares = 0.f;
+        for( int i=0; i<nFrames; i++ )
+        {
+            auto val = rptr[i];
+            maxAbs = std::max(maxAbs, std::abs(val));
+            sumSquares += val * val;
+        }
+        algo_max.feedBlockMax(maxAbs);
+        
+        bool const wasOpen = gate.isOpen();
+        auto const rms = nFrames ? std::sqrt(sumSquares / nFrames) : 0.f;
+        if(!gate.feed(rms))
+        {
+            algo_freq.setUpperZero(gate.zeroThreshold());
+            if(wasOpen) {
+                // don't report frequencies based on zero crossings of the noise
+                algo_freq.reset();
+                return SpectralStep::Silence;
+            }
+            return SpectralStep::None;
+        }
+        
         for( int i=0; i<nFrames; i++ )
         {
             auto val = *rptr++;
-            algo_max.feed(val);
             
             // filter high frequencies
             avg.feed(val);
             auto filtered_value = avg.compute();
             algo_freq.feed(filtered_value);
         }
+        return SpectralStep::Feed;
     }
     else {
         algo_max.forget();
         algo_freq.forget();
+        spectral.forEachSensor([](auto & s) {
+            s.forget();
+        });
+        return SpectralStep::None;
     }
 }
 
+bool SilenceGate::feed(float rms)
+{
+  if(rms <= 0.f) {
+    if(open && ++silent_blocks >= hangover_blocks) {
+      open = false;
+    }
+    return open;
+  }
+
+  if(noise_floor < 0.f || rms < noise_floor) {
+    // first block : we have no other choice than considering it is noise.
+    noise_floor = std::max(rms, min_noise_floor);
+  }
+
+  if(open) {
+    if(rms < close_ratio * noise_floor) {
+      // the floor is only measured on silent blocks, else it would rise towards a steady signal.
+      noise_floor += noise_floor_rise * (rms - noise_floor);
+      if(++silent_blocks >= hangover_blocks) {
+        open = false;
+      }
+    }
+    else {
+      silent_blocks = 0;
+    }
+  }
+  else {
+    if(rms > open_ratio * noise_floor) {
+      open = true;
+      silent_blocks = 0;
+    }
+    else {
+      noise_floor += noise_floor_rise * (rms - noise_floor);
+    }
+  }
+  return open;
+}
+
+void SpectralFeatures::analyze()
+{
+  float sumSquares = 0.f;
+  for(int i=0; i<frame_size; ++i) {
+    sumSquares += input[i] * input[i];
+    frame[i] = static_cast<kiss_fft_scalar>(input[i] * window[i]);
+  }
+  pending.rms = std::sqrt(sumSquares / frame_size);
+
+  kiss_fftr(fft.get(), frame.data(), spectrum.data());
+
+  float sumMag = 0.f, weightedSumMag = 0.f, flux = 0.f;
+  for(int k=0; k<=frame_size/2; ++k) {
+    auto const & c = spectrum[k];
+    auto const m = static_cast<float>(std::sqrt(c.r * c.r + c.i * c.i));
+    magnitudes[k] = m;
+    sumMag += m;
+    weightedSumMag += m * k;
+    // half-wave rectified: only increases of energy indicate an onset
+    flux += std::max(0.f, m - prev_magnitudes[k]);
+  }
+  pending.centroid = sumMag > 0.f ? (weightedSumMag / sumMag) * sample_rate / frame_size : 0.f;
+
+  for(int b=0; b<n_bands; ++b) {
+    float energy = 0.f;
+    for(int k=band_bins[b].first; k<band_bins[b].second; ++k) {
+      energy += magnitudes[k] * magnitudes[k];
+    }
+    // Parseval : a sine of amplitude A in the band gives A^2 / 2
+    pending.bands[b] = 2.f * energy / (frame_size * window_power);
+  }
+
+  auto const reference = std::max(flux_average, min_flux_average);
+  if(flux > onset_ratio * reference) {
+    pending.onset = std::max(pending.onset, flux / reference);
+  }
+  flux_average += flux_average_smoothing * (flux - flux_average);
+
+  std::swap(magnitudes, prev_magnitudes);
+  pending.valid = true;
+}
+
 bool AudioIn::Init()
 {
 #ifdef NO_AUDIO_IN
@@ -42,6 +174,11 @@ bool AudioIn::Init()
     data.algo_max.setActivator(this);
     data.algo_freq.setActivator(this);
 
+    data.spectral.forEachSensor([this](auto & s) {
+        s.Register();
+        s.setActivator(this);
+    });
+
     bInitialized_ = true;
 #endif
   return true;
@@ -53,9 +190,27 @@ bool AudioIn::do_wakeup() {
   return false;
 #else  // NO_AUDIO_IN
   LG(INFO, "AudioIn::do_wakeup : AudioIn will wake up");
+  if(device_sample_rate != sample_rate) {
+    resampler.emplace(device_sample_rate, sample_rate, 1, resampling_chunk);
+    resampled.resize(resampler->maxOutputFrames(resampling_chunk));
+  }
+  else {
+    resampler.reset();
+  }
   bool const res = audio_input.Init([this](const SAMPLE * buffer, int nFrames) {
-    data.step(buffer, nFrames);
-  }, sample_rate, min_latency);
+    if(!resampler || !buffer) {
+      data.step(buffer, nFrames);
+      return;
+    }
+    while(nFrames > 0) {
+      auto const n = std::min(nFrames, resampling_chunk);
+      if(auto const produced = resampler->feed(buffer, n, resampled.data())) {
+        data.step(resampled.data(), produced);
+      }
+      buffer += n;
+      nFrames -= n;
+    }
+  }, device_sample_rate, min_latency);
   if (res) {
     LG(INFO, "AudioIn::do_wakeup : AudioIn is woken up");
   }
@@ -87,6 +242,9 @@ void AudioIn::TearDown()
     Activator::sleep();
 
     if(bInitialized_) {
+        data.spectral.forEachSensor([](auto & s) {
+            s.Unregister();
+        });
         data.algo_freq.Unregister();
         data.algo_max.Unregister();
         
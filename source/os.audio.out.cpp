@@ -1,4 +1,59 @@
+#include "private.h"
 
-namespace imajuscule {
+namespace imajuscule::audio {
 
+void outputData::step(SAMPLE * outputBuffer, int nFrames) {
+  if(auto r = resampling.load(std::memory_order_acquire)) {
+    r->render(outputBuffer, nFrames, [this](SAMPLE * buffer, int n) {
+      renderChannels(buffer, n);
+    });
+  }
+  else {
+    renderChannels(outputBuffer, nFrames);
+  }
 }
+
+void outputData::renderChannels(SAMPLE * outputBuffer, int nFrames) {
+  timed.render(nFrames, [this, outputBuffer](int offset, int n) {
+    outputDataBaseT::step(outputBuffer + offset * nOutChannels, n);
+  }, [](TimedCommand const & c) {
+    c.apply(*c.target, c);
+  });
+
+  // sequentially consistent, together with 'setMixSource' : either the source is not seen here,
+  // or 'setMixSource' waits until it is not used anymore.
+  mixing.store(true);
+  if(auto source = mix_source.load()) {
+    source->mixInto(outputBuffer, nFrames);
+  }
+  mixing.store(false, std::memory_order_release);
+}
+
+void outputData::setMixSource(MixSource * source) {
+  mix_source.store(source);
+  while(mixing.load()) {
+    std::this_thread::yield();
+  }
+}
+
+void outputData::startResampling(int content_rate, int device_rate) {
+  Assert(!resampling.load(std::memory_order_relaxed));
+  resampled = std::make_unique<ResampledRenderer>(content_rate, device_rate, nOutChannels);
+  resampling.store(resampled.get(), std::memory_order_release);
+}
+
+void outputData::stopResampling() {
+  resampling.store(nullptr, std::memory_order_release);
+  resampled.reset();
+}
+
+bool AudioOut::renderOffline(SAMPLE * outputBuffer, int nFrames) {
+  if(Initialized()) {
+    LG(ERR, "AudioOut::renderOffline : the device is rendering");
+    return false;
+  }
+  getChannelHandler().step(outputBuffer, nFrames);
+  return true;
+}
+
+} // NS imajuscule::audio
@@ -0,0 +1,125 @@
+#include "private.h"
+
+namespace imajuscule::audio {
+
+PolyphaseFilter::PolyphaseFilter(int up, int down, int taps_per_phase)
+: up(up)
+, down(down)
+, taps(taps_per_phase)
+, coeffs(static_cast<size_t>(up) * taps_per_phase)
+{
+  int const N = up * taps;
+  // the center is on the upsampled grid, so that the delay is a whole number of source frames
+  double const center = 0.5 * N;
+  // cutoff in cycles per sample, at the upsampled rate
+  double const cutoff = 0.5 * rolloff / std::max(up, down);
+  double const i0_beta = besselI0(kaiser_beta);
+
+  for(int phase = 0; phase < up; ++phase) {
+    for(int t = 0; t < taps; ++t) {
+      int const n = phase + (taps - 1 - t) * up;
+      double const x = n - center;
+      double const sinc = (x == 0.) ? 1. : std::sin(2. * M_PI * cutoff * x) / (2. * M_PI * cutoff * x);
+      double const r = x / (0.5 * N);
+      double const window = besselI0(kaiser_beta * std::sqrt(std::max(0., 1. - r * r))) / i0_beta;
+      // the 'up' factor compensates for the zeros inserted by upsampling
+      coeffs[phase * taps + t] = static_cast<float>(up * 2. * cutoff * sinc * window);
+    }
+  }
+}
+
+double PolyphaseFilter::besselI0(double x) {
+  double sum = 1., term = 1.;
+  double const half_x_sq = 0.25 * x * x;
+  for(int k = 1; k < 50; ++k) {
+    term *= half_x_sq / (static_cast<double>(k) * k);
+    sum += term;
+    if(term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+std::shared_ptr<PolyphaseFilter const> getPolyphaseFilter(int from_rate, int to_rate, int taps_per_phase) {
+  Assert(from_rate > 0 && to_rate > 0);
+  auto const g = std::gcd(from_rate, to_rate);
+  auto const up = to_rate / g;
+  auto const down = from_rate / g;
+  if(unlikely(up > 4096)) {
+    LG(WARN, "getPolyphaseFilter : %d -> %d needs %d phases", from_rate, to_rate, up);
+  }
+  return SharedCache<std::tuple<int, int, int>, PolyphaseFilter>::get(std::make_tuple(up, down, taps_per_phase),
+                                                                      up, down, taps_per_phase);
+}
+
+std::vector<float> Resampler::convert(std::vector<float> const & in, int nChannels, int from_rate, int to_rate) {
+  if(from_rate == to_rate) {
+    return in;
+  }
+  Resampler r(from_rate, to_rate, nChannels);
+  int const nFrames = static_cast<int>(in.size()) / nChannels;
+  int const nPad = r.latency();
+  std::vector<float> res(static_cast<size_t>(r.maxOutputFrames(nFrames + nPad)) * nChannels);
+  int produced = r.feed(in.data(), nFrames, res.data());
+  // flush the filter with silence so that the tail is not lost
+  std::vector<float> const zeros(static_cast<size_t>(nPad) * nChannels, 0.f);
+  produced += r.feed(zeros.data(), nPad, res.data() + produced * nChannels);
+  res.resize(static_cast<size_t>(produced) * nChannels);
+  return res;
+}
+
+int Resampler::feedChunk(float const * in, int nFrames, float * out) {
+  auto const taps = filter->taps;
+  auto const up = filter->up;
+  auto const down = filter->down;
+
+  int produced = 0;
+  int endPhase = phase;
+  int endOffset = offset;
+  for(int c = 0; c < n_channels; ++c) {
+    auto & h = history[c];
+    for(int i = 0; i < nFrames; ++i) {
+      h.push_back(in[i * n_channels + c]);
+    }
+
+    int p = phase;
+    int pos = offset;
+    int k = 0;
+    int const last = static_cast<int>(h.size()) - taps;
+    for(; pos <= last; ++k) {
+      out[k * n_channels + c] = dot(h.data() + pos, filter->phaseCoefficients(p), taps);
+      p += down;
+      pos += p / up;
+      p %= up;
+    }
+    // when downsampling, 'pos' can go past the samples received so far.
+    auto const erased = std::min(pos, static_cast<int>(h.size()));
+    h.erase(h.begin(), h.begin() + erased);
+
+    produced = k;
+    endPhase = p;
+    endOffset = pos - erased;
+  }
+  phase = endPhase;
+  offset = endOffset;
+  return produced;
+}
+
+// written with independent accumulators so that the compiler vectorizes it.
+float Resampler::dot(float const * a, float const * b, int n) {
+  float acc0 = 0.f, acc1 = 0.f, acc2 = 0.f, acc3 = 0.f;
+  int i = 0;
+  for(; i + 4 <= n; i += 4) {
+    acc0 += a[i]   * b[i];
+    acc1 += a[i+1] * b[i+1];
+    acc2 += a[i+2] * b[i+2];
+    acc3 += a[i+3] * b[i+3];
+  }
+  for(; i < n; ++i) {
+    acc0 += a[i] * b[i];
+  }
+  return (acc0 + acc1) + (acc2 + acc3);
+}
+
+} // NS imajuscule::audio
@@ -0,0 +1,506 @@
+#include "private.h"
+
+#include <climits>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace imajuscule::audio::shm {
+
+namespace {
+
+// futexes are not private : the waiter and the waker are in different processes.
+
+void futexWait(std::atomic<uint32_t> & a, uint32_t expected, std::chrono::milliseconds timeout) {
+  auto const s = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+  timespec ts;
+  ts.tv_sec = s.count();
+  ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - s).count();
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&a), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<uint32_t> & a) {
+  a.fetch_add(1, std::memory_order_release);
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&a), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+std::string segmentName(std::string const & name) {
+  return "/os.audio." + name;
+}
+
+bool isAlive(int32_t pid) {
+  return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+std::optional<ChannelClosingPolicy> toClosingPolicy(uint8_t v) {
+  for(auto p : {ChannelClosingPolicy::AutoClose, ChannelClosingPolicy::ExplicitClose}) {
+    if(static_cast<uint8_t>(p) == v) {
+      return p;
+    }
+  }
+  return {};
+}
+
+std::optional<CloseMode> toCloseMode(uint8_t v) {
+  for(auto m : {CloseMode::NOW, CloseMode::XFADE_ZERO}) {
+    if(static_cast<uint8_t>(m) == v) {
+      return m;
+    }
+  }
+  return {};
+}
+
+} // NS
+
+Server::Server(AudioOut & out, std::string name_)
+: out(out)
+, name(segmentName(name_))
+, streams(std::make_unique<std::array<Stream, n_channel_ids>>())
+{
+  if(!lockName()) {
+    return;
+  }
+  if(ftruncate(fd, sizeof(Segment)) != 0) {
+    LG(ERR, "shm::Server : ftruncate failed (%d)", errno);
+    shm_unlink(name.c_str());
+    close(fd);
+    fd = -1;
+    return;
+  }
+  void * p = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED) {
+    LG(ERR, "shm::Server : mmap failed (%d)", errno);
+    shm_unlink(name.c_str());
+    close(fd);
+    fd = -1;
+    return;
+  }
+  segment = new (p) Segment();
+  segment->version = version;
+  segment->server_pid.store(getpid(), std::memory_order_relaxed);
+  publishSampleRate();
+  // clients check the magic before using the segment
+  segment->magic.store(shm::magic, std::memory_order_release);
+
+  out.getChannelHandler().setMixSource(this);
+}
+
+Server::~Server() {
+  if(!segment) {
+    return;
+  }
+  // from now on, the render thread doesn't use the streams
+  out.getChannelHandler().setMixSource(nullptr);
+  for(auto & s : *streams) {
+    if(s.current) {
+      freeBlock(*s.current);
+    }
+    while(auto e = s.entries.tryPop()) {
+      freeBlock(*e);
+    }
+  }
+  for(int i=0; i<n_slots; ++i) {
+    releaseSlot(i);
+  }
+  segment->magic.store(0, std::memory_order_release);
+  munmap(segment, sizeof(Segment));
+  shm_unlink(name.c_str());
+  // releases the lock
+  close(fd);
+}
+
+// Opens the segment named 'name', and locks it. A segment that is not locked was left by a server
+// that crashed : clients of this server may still map it, so it is replaced by a new one.
+bool Server::lockName() {
+  for(int attempt = 0; attempt < 10; ++attempt) {
+    fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    if(fd < 0) {
+      LG(ERR, "shm::Server : shm_open '%s' failed (%d)", name.c_str(), errno);
+      return false;
+    }
+    if(flock(fd, LOCK_EX | LOCK_NB) != 0) {
+      if(errno == EWOULDBLOCK) {
+        LG(ERR, "shm::Server : a server named '%s' is already running", name.c_str());
+      }
+      else {
+        LG(ERR, "shm::Server : flock failed (%d)", errno);
+      }
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    // the segment that was locked may have been replaced by another server in the meantime
+    struct stat locked, named;
+    bool same = false;
+    if(fstat(fd, &locked) == 0) {
+      int const other = shm_open(name.c_str(), O_RDWR, 0);
+      if(other >= 0) {
+        same = fstat(other, &named) == 0 && named.st_dev == locked.st_dev && named.st_ino == locked.st_ino;
+        close(other);
+      }
+    }
+    if(same && locked.st_size == 0) {
+      // a new segment
+      return true;
+    }
+    if(same) {
+      // the previous server crashed without unlinking the segment
+      shm_unlink(name.c_str());
+    }
+    close(fd);
+    fd = -1;
+  }
+  LG(ERR, "shm::Server : could not create '%s'", name.c_str());
+  return false;
+}
+
+void Server::publishSampleRate() {
+  segment->sample_rate.store(out.getSampleRate().value_or(AudioOut::AudioCtxt::lazySamplingRate),
+                             std::memory_order_relaxed);
+}
+
+int Server::process(std::chrono::milliseconds timeout) {
+  if(!segment) {
+    return 0;
+  }
+  // the device may have been initialized since the last call
+  publishSampleRate();
+  // read before processing, so that a command pushed during processing interrupts the wait.
+  auto const doorbell = segment->doorbell.load(std::memory_order_acquire);
+  int n = 0;
+  for(int i=0; i<n_slots; ++i) {
+    n += processSlot(i);
+  }
+  if(n == 0) {
+    futexWait(segment->doorbell, doorbell, timeout);
+  }
+  return n;
+}
+
+int Server::processSlot(int i) {
+  auto & slot = segment->slots[i];
+  auto const owner = slot.owner.load(std::memory_order_acquire);
+  if(!owner) {
+    return 0;
+  }
+  if(phases[i] == SlotPhase::Draining) {
+    releaseSlot(i);
+    return 0;
+  }
+  if(unlikely(!isAlive(owner))) {
+    // maybe during the initialization of the slot
+    LG(WARN, "shm::Server : client of slot %d is gone", i);
+    releaseSlot(i);
+    return 0;
+  }
+  if(!slot.ready.load(std::memory_order_acquire)) {
+    return 0;
+  }
+  phases[i] = SlotPhase::Used;
+
+  int n = 0;
+  while(auto c = slot.commands.tryPop()) {
+    execute(i, *c);
+    ++n;
+  }
+  // the commands sent before releasing are processed
+  if(slot.released.load(std::memory_order_acquire)) {
+    releaseSlot(i);
+  }
+  return n;
+}
+
+bool Server::owns(int i, uint8_t channel) const {
+  auto const & v = channels[i];
+  return std::find(v.begin(), v.end(), channel) != v.end();
+}
+
+bool Server::pushEntry(uint8_t channel, StreamEntry const & e) {
+  if(!(*streams)[channel].entries.tryPush(e)) {
+    LG(ERR, "shm::Server : stream of channel %d is full", channel);
+    return false;
+  }
+  return true;
+}
+
+void Server::execute(int i, Command const & c) {
+  auto & slot = segment->slots[i];
+  switch(c.type) {
+    case CommandType::OpenChannel:
+    {
+      int32_t result = no_channel;
+      auto const policy = toClosingPolicy(c.param8);
+      if(!policy || c.param32 <= 0 || c.param32 > max_xfade_length || !std::isfinite(c.volume)) {
+        LG(ERR, "shm::Server : invalid OpenChannel from slot %d", i);
+        if(!slot.replies.tryPush({c.seq, result})) {
+          LG(ERR, "shm::Server : replies of slot %d are full", i);
+        }
+        futexWakeAll(slot.reply_doorbell);
+        break;
+      }
+      auto const id = out.openChannel(c.volume, *policy, c.param32);
+      if(id == std::numeric_limits<uint8_t>::max()) {
+        LG(ERR, "shm::Server : no channel available for slot %d", i);
+      }
+      else {
+        channels[i].push_back(id);
+        // the blocks of the channel start at the volume of the channel
+        pushEntry(id, {StreamEntry::Open, static_cast<uint8_t>(i), -1, 0, c.volume});
+        result = id;
+      }
+      if(!slot.replies.tryPush({c.seq, result})) {
+        LG(ERR, "shm::Server : replies of slot %d are full", i);
+      }
+      futexWakeAll(slot.reply_doorbell);
+      break;
+    }
+    case CommandType::ToVolume:
+      if(c.param32 < 0 || !std::isfinite(c.volume)) {
+        LG(ERR, "shm::Server : invalid ToVolume from slot %d", i);
+        break;
+      }
+      if(owns(i, c.channel)) {
+        out.toVolume(c.channel, c.volume, c.param32);
+        pushEntry(c.channel, {StreamEntry::Volume, static_cast<uint8_t>(i), -1, c.param32, c.volume});
+      }
+      break;
+    case CommandType::CloseChannel:
+    {
+      auto const mode = toCloseMode(c.param8);
+      if(!mode) {
+        LG(ERR, "shm::Server : invalid CloseChannel from slot %d", i);
+        break;
+      }
+      if(owns(i, c.channel)) {
+        out.closeChannel(c.channel, *mode);
+        auto & v = channels[i];
+        v.erase(std::remove(v.begin(), v.end(), c.channel), v.end());
+      }
+      break;
+    }
+    case CommandType::PlayBlock:
+    {
+      if(c.block < 0 || c.block >= n_blocks ||
+         slot.block_states[c.block].load(std::memory_order_acquire) != BlockSubmitted) {
+        LG(ERR, "shm::Server : invalid block %d", c.block);
+        break;
+      }
+      StreamEntry const e{StreamEntry::Block, static_cast<uint8_t>(i), static_cast<int16_t>(c.block),
+                          std::clamp(c.param32, 0, n_block_frames), 0.f};
+      blocks_in_flight[i].fetch_add(1, std::memory_order_relaxed);
+      if(!owns(i, c.channel) || !pushEntry(c.channel, e)) {
+        freeBlock(e);
+      }
+      break;
+    }
+  }
+}
+
+void Server::freeBlock(StreamEntry const & e) {
+  if(e.kind != StreamEntry::Block) {
+    return;
+  }
+  segment->slots[e.slot].block_states[e.block].store(BlockFree, std::memory_order_release);
+  blocks_in_flight[e.slot].fetch_sub(1, std::memory_order_release);
+}
+
+void Server::releaseSlot(int i) {
+  for(auto id : channels[i]) {
+    out.closeChannel(id, CloseMode::NOW);
+  }
+  channels[i].clear();
+  auto & slot = segment->slots[i];
+  // the slot is reused once the render thread doesn't read its blocks anymore
+  if(blocks_in_flight[i].load(std::memory_order_acquire)) {
+    phases[i] = SlotPhase::Draining;
+    return;
+  }
+  phases[i] = SlotPhase::Unused;
+  slot.ready.store(0, std::memory_order_relaxed);
+  slot.released.store(0, std::memory_order_relaxed);
+  slot.owner.store(0, std::memory_order_release);
+}
+
+void Server::mixInto(SAMPLE * outputBuffer, int nFrames) {
+  static_assert(n_block_channels == outputData::nOutChannels);
+  for(auto & s : *streams) {
+    int done = 0;
+    while(done < nFrames) {
+      if(!s.current) {
+        s.current = s.entries.tryPop();
+        if(!s.current) {
+          break;
+        }
+        s.position = 0;
+        switch(s.current->kind) {
+          case StreamEntry::Open:
+            s.volume = s.current->volume;
+            s.volume_steps = 0;
+            s.current.reset();
+            continue;
+          case StreamEntry::Volume:
+            s.volume_steps = std::max(1, s.current->n);
+            s.volume_increment = (s.current->volume - s.volume) / s.volume_steps;
+            s.current.reset();
+            continue;
+          case StreamEntry::Block:
+            break;
+        }
+      }
+      auto const & e = *s.current;
+      float const * block = segment->slots[e.slot].blocks[e.block];
+      auto const n = std::min(nFrames - done, e.n - s.position);
+      for(int f = 0; f < n; ++f) {
+        if(s.volume_steps) {
+          s.volume += s.volume_increment;
+          --s.volume_steps;
+        }
+        for(int c = 0; c < n_block_channels; ++c) {
+          outputBuffer[(done + f) * n_block_channels + c] += s.volume * block[(s.position + f) * n_block_channels + c];
+        }
+      }
+      done += n;
+      s.position += n;
+      if(s.position >= e.n) {
+        freeBlock(e);
+        s.current.reset();
+      }
+    }
+  }
+}
+
+Client::Client(std::string const & name) {
+  auto const n = segmentName(name);
+  int const fd = shm_open(n.c_str(), O_RDWR, 0);
+  if(fd < 0) {
+    LG(ERR, "shm::Client : no server '%s' (%d)", n.c_str(), errno);
+    return;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size != static_cast<off_t>(sizeof(Segment))) {
+    LG(ERR, "shm::Client : '%s' has an unexpected size", n.c_str());
+    close(fd);
+    return;
+  }
+  void * p = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED) {
+    LG(ERR, "shm::Client : mmap failed (%d)", errno);
+    return;
+  }
+  auto s = static_cast<Segment*>(p);
+  if(s->magic.load(std::memory_order_acquire) != shm::magic || s->version != version) {
+    LG(ERR, "shm::Client : '%s' is not compatible", n.c_str());
+    munmap(p, sizeof(Segment));
+    return;
+  }
+  for(auto & candidate : s->slots) {
+    int32_t expected = 0;
+    if(!candidate.owner.compare_exchange_strong(expected, getpid(), std::memory_order_acq_rel)) {
+      continue;
+    }
+    // the server doesn't use the slot until it is ready
+    candidate.commands.reset();
+    candidate.replies.reset();
+    for(auto & b : candidate.block_states) {
+      b.store(BlockFree, std::memory_order_relaxed);
+    }
+    candidate.released.store(0, std::memory_order_relaxed);
+    candidate.ready.store(1, std::memory_order_release);
+    segment = s;
+    slot = &candidate;
+    return;
+  }
+  LG(ERR, "shm::Client : all slots are used");
+  munmap(p, sizeof(Segment));
+}
+
+Client::~Client() {
+  if(!segment) {
+    return;
+  }
+  slot->released.store(1, std::memory_order_release);
+  futexWakeAll(segment->doorbell);
+  munmap(segment, sizeof(Segment));
+}
+
+bool Client::send(Command c) {
+  if(unlikely(!slot)) {
+    return false;
+  }
+  if(!slot->commands.tryPush(c)) {
+    LG(ERR, "shm::Client : commands are full");
+    return false;
+  }
+  futexWakeAll(segment->doorbell);
+  return true;
+}
+
+std::optional<uint8_t> Client::openChannel(float volume, ChannelClosingPolicy p, int xfade_length,
+                                           std::chrono::milliseconds timeout) {
+  auto const s = ++seq;
+  if(!send({s, CommandType::OpenChannel, 0, static_cast<uint8_t>(p), 0, xfade_length, volume, -1})) {
+    return {};
+  }
+  auto const deadline = std::chrono::steady_clock::now() + timeout;
+  while(true) {
+    auto const doorbell = slot->reply_doorbell.load(std::memory_order_acquire);
+    while(auto r = slot->replies.tryPop()) {
+      if(r->seq == s) {
+        if(r->result == no_channel) {
+          LG(ERR, "shm::Client : the server could not open a channel");
+          return {};
+        }
+        return static_cast<uint8_t>(r->result);
+      }
+    }
+    auto const now = std::chrono::steady_clock::now();
+    if(now >= deadline) {
+      LG(ERR, "shm::Client : the server didn't reply");
+      return {};
+    }
+    futexWait(slot->reply_doorbell, doorbell,
+              std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1));
+  }
+}
+
+bool Client::toVolume(uint8_t channel_id, float volume, int nSteps) {
+  return send({++seq, CommandType::ToVolume, channel_id, 0, 0, nSteps, volume, -1});
+}
+
+bool Client::closeChannel(uint8_t channel_id, CloseMode mode) {
+  return send({++seq, CommandType::CloseChannel, channel_id, static_cast<uint8_t>(mode), 0, 0, 0.f, -1});
+}
+
+float * Client::acquireBlock(int & index) {
+  if(unlikely(!slot)) {
+    return nullptr;
+  }
+  for(int i=0; i<n_blocks; ++i) {
+    uint32_t expected = BlockFree;
+    if(slot->block_states[i].compare_exchange_strong(expected, BlockWritten, std::memory_order_acquire)) {
+      index = i;
+      return slot->blocks[i];
+    }
+  }
+  return nullptr;
+}
+
+bool Client::submitBlock(uint8_t channel_id, int index, int nFrames) {
+  if(unlikely(!slot) || index < 0 || index >= n_blocks) {
+    return false;
+  }
+  slot->block_states[index].store(BlockSubmitted, std::memory_order_release);
+  if(!send({++seq, CommandType::PlayBlock, channel_id, 0, 0, nFrames, 0.f, index})) {
+    slot->block_states[index].store(BlockFree, std::memory_order_release);
+    return false;
+  }
+  return true;
+}
+
+} // NS imajuscule::audio::shm
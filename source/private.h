@@ -1,3 +1,5 @@
+#pragma once
+
 #include "../include/public.h"
 
 #define  _USE_MATH_DEFINES
@@ -2,6 +2,11 @@
 
 #include "os.audio.cpp"
 #include "os.audio.out.cpp"
+#include "os.audio.resample.cpp"
+
+#ifdef __linux__
+# include "os.audio.shm.cpp"
+#endif
 
 #ifndef NO_AUDIO_IN
 # include "os.audio.in.cpp"
@@ -0,0 +1,118 @@
+// Records commands issued to an 'AudioOut' rendered offline, and checks that replaying
+// the log twice, with the same block size, renders the same frames.
+
+#include "../source/private.h"
+#include "test.h"
+
+using namespace imajuscule;
+using namespace imajuscule::audio;
+
+namespace {
+
+constexpr int record_frames = 44100;
+constexpr int replay_block_size = 256;
+
+// Requests are not recorded : 'play' commands are replayed as decaying sines, mixed after the channels.
+struct Bursts : MixSource {
+  void start(uint8_t channel_id) {
+    bursts.push_back({0, 0.1f * (1 + channel_id % 4)});
+  }
+
+  void mixInto(SAMPLE * outputBuffer, int nFrames) override {
+    for(auto & b : bursts) {
+      for(int i = 0; i < nFrames; ++i, ++b.frame) {
+        auto const v = b.volume * std::exp(-b.frame / 2000.f) * std::sin(0.05f * b.frame);
+        for(int c = 0; c < AudioOut::nAudioOut; ++c) {
+          outputBuffer[i * AudioOut::nAudioOut + c] += v;
+        }
+      }
+    }
+  }
+
+private:
+  struct Burst {
+    int frame;
+    float volume;
+  };
+  std::vector<Burst> bursts;
+};
+
+// Issues commands between blocks of various sizes, like a device callback would render them.
+bool record(std::string const & path) {
+  AudioOut out;
+  out.startRecording();
+  std::vector<SAMPLE> buffer(1024 * AudioOut::nAudioOut);
+  std::vector<uint8_t> channels;
+  int rendered = 0;
+  for(int b = 0; rendered < record_frames; ++b) {
+    if(b % 7 == 0) {
+      channels.push_back(out.openChannel(0.5f, ChannelClosingPolicy::ExplicitClose, 201));
+      out.play(channels.back(), StackVector<AudioOut::Request>(1));
+    }
+    if(b % 5 == 0) {
+      for(auto id : channels) {
+        out.toVolume(id, (b / 5) % 2 ? 1.f : 0.2f, 100);
+        if(!out.toVolumeAt(out.getRenderedFrames() + 300 + b, id, 0.7f, 50)) {
+          return false;
+        }
+      }
+    }
+    if(b % 11 == 10 && !channels.empty()) {
+      out.closeChannel(channels.front(), CloseMode::XFADE_ZERO);
+      channels.erase(channels.begin());
+    }
+    int const n = std::min(1 + (b * 97) % 1024, record_frames - rendered);
+    if(!out.renderOffline(buffer.data(), n)) {
+      return false;
+    }
+    rendered += n;
+  }
+  return out.stopRecording(path);
+}
+
+std::optional<std::vector<SAMPLE>> replayLog(std::vector<RecordedCommand> const & commands) {
+  AudioOut out;
+  Bursts bursts;
+  out.getChannelHandler().setMixSource(&bursts);
+  std::vector<SAMPLE> rendered;
+  AudioOutReplayTarget<AudioOut> target(out,
+                                        [&](AudioOut &, uint8_t channel_id, int) { bursts.start(channel_id); },
+                                        {},
+                                        [&](SAMPLE const * frames, int nFrames) {
+                                          rendered.insert(rendered.end(), frames, frames + nFrames * AudioOut::nAudioOut);
+                                        });
+  bool const res = replay(commands, replay_block_size, target, record_frames);
+  out.getChannelHandler().setMixSource(nullptr);
+  if(!res) {
+    return {};
+  }
+  return rendered;
+}
+
+} // NS
+
+int main() {
+  std::string const path = "os.audio.replay.test.log";
+  TEST_CHECK(record(path));
+
+  auto const log = CommandRecorder::load(path);
+  TEST_CHECK(log);
+  if(!log) {
+    return test::status();
+  }
+  auto const & commands = log->second;
+  TEST_CHECK(!commands.empty());
+
+  auto const a = replayLog(commands);
+  auto const b = replayLog(commands);
+  TEST_CHECK(a && b);
+  if(a && b) {
+    // the replay renders at least the length of the recording, in whole blocks
+    TEST_CHECK(a->size() >= static_cast<size_t>(record_frames) * AudioOut::nAudioOut);
+    TEST_CHECK(a->size() % (replay_block_size * AudioOut::nAudioOut) == 0);
+    TEST_CHECK(std::any_of(a->begin(), a->end(), [](SAMPLE s) { return s != 0.f; }));
+    TEST_CHECK(*a == *b);
+  }
+  std::remove(path.c_str());
+  return test::status();
+}
@@ -0,0 +1,119 @@
+// Checks that the resampler is phase-aligned and accurate, and that the result
+// doesn't depend on how the stream is split in blocks.
+
+#include "../source/private.h"
+#include "test.h"
+
+using namespace imajuscule;
+using namespace imajuscule::audio;
+
+namespace {
+
+// the error measured with the default filter is around 3e-5 for a 440 Hz sine.
+constexpr double max_error = 1e-4;
+// frames at the start and at the end of the stream, where the filter sees zeros.
+constexpr int edge = 200;
+
+float sine(int64_t i, int sample_rate) {
+  return static_cast<float>(std::sin(2. * M_PI * 440. * i / sample_rate));
+}
+
+// Frame i of the output corresponds to frame i of the input, at the output rate.
+void testConvert(int from_rate, int to_rate) {
+  std::vector<float> in(from_rate);
+  for(int i = 0; i < from_rate; ++i) {
+    in[i] = sine(i, from_rate);
+  }
+  auto const out = Resampler::convert(in, 1, from_rate, to_rate);
+  TEST_CHECK(static_cast<int>(out.size()) == to_rate);
+
+  double err = 0.;
+  for(int i = edge; i < static_cast<int>(out.size()) - edge; ++i) {
+    err = std::max(err, static_cast<double>(std::abs(out[i] - sine(i, to_rate))));
+  }
+  if(err > max_error) {
+    std::fprintf(stderr, "%d -> %d : error %g\n", from_rate, to_rate, err);
+  }
+  TEST_CHECK(err <= max_error);
+}
+
+// Feeding the same stream in blocks of various sizes, on 2 channels, produces the same frames.
+void testStreaming(int from_rate, int to_rate) {
+  constexpr int n_channels = 2;
+  std::vector<float> in(from_rate * n_channels);
+  for(int i = 0; i < from_rate; ++i) {
+    in[i * n_channels] = sine(i, from_rate);
+    in[i * n_channels + 1] = -sine(i, from_rate);
+  }
+
+  auto stream = [&](int max_frames_per_chunk, int blockSize) {
+    Resampler r(from_rate, to_rate, n_channels, max_frames_per_chunk);
+    std::vector<float> out(r.maxOutputFrames(from_rate) * n_channels);
+    int produced = 0;
+    for(int i = 0; i < from_rate; i += blockSize) {
+      auto const n = std::min(blockSize, from_rate - i);
+      auto const p = r.feed(&in[i * n_channels], n, &out[produced * n_channels]);
+      TEST_CHECK(p <= r.maxOutputFrames(n));
+      produced += p;
+    }
+    out.resize(produced * n_channels);
+    return out;
+  };
+
+  auto const reference = stream(1024, 1000);
+  TEST_CHECK(static_cast<int>(reference.size()) >= (to_rate - to_rate / 100) * n_channels);
+  for(int i = 0; i < static_cast<int>(reference.size()) / n_channels; ++i) {
+    TEST_CHECK(reference[i * n_channels] == -reference[i * n_channels + 1]);
+  }
+  TEST_CHECK(stream(37, 1000) == reference);
+  TEST_CHECK(stream(1024, 1) == reference);
+  TEST_CHECK(stream(64, 441) == reference);
+}
+
+// The resampled renderer produces the same frames, whatever the count of frames requested at a time.
+void testRenderer(int from_rate, int to_rate) {
+  constexpr int n_channels = 2;
+  constexpr int n_frames = 20000;
+
+  auto render = [&](auto blockSize) {
+    ResampledRenderer r(from_rate, to_rate, n_channels);
+    std::vector<float> out(n_frames * n_channels);
+    int64_t source_frame = 0;
+    for(int i = 0, block = 0; i < n_frames; ++block) {
+      auto const n = std::min(blockSize(block), n_frames - i);
+      r.render(&out[i * n_channels], n, [&](float * buf, int nFrames) {
+        for(int j = 0; j < nFrames; ++j, ++source_frame) {
+          buf[j * n_channels] = sine(source_frame, from_rate);
+          buf[j * n_channels + 1] = -sine(source_frame, from_rate);
+        }
+      });
+      i += n;
+    }
+    return out;
+  };
+
+  auto const reference = render([](int) { return 512; });
+  double err = 0.;
+  for(int i = edge; i < n_frames; ++i) {
+    err = std::max(err, static_cast<double>(std::abs(reference[i * n_channels] - sine(i, to_rate))));
+    err = std::max(err, static_cast<double>(std::abs(reference[i * n_channels + 1] + sine(i, to_rate))));
+  }
+  if(err > max_error) {
+    std::fprintf(stderr, "renderer %d -> %d : error %g\n", from_rate, to_rate, err);
+  }
+  TEST_CHECK(err <= max_error);
+
+  TEST_CHECK(render([](int) { return 1; }) == reference);
+  TEST_CHECK(render([](int block) { return 1 + (block * 37) % 500; }) == reference);
+}
+
+} // NS
+
+int main() {
+  for(auto [from_rate, to_rate] : {std::pair{44100, 48000}, {48000, 44100}, {96000, 44100}, {22050, 48000}}) {
+    testConvert(from_rate, to_rate);
+    testStreaming(from_rate, to_rate);
+    testRenderer(from_rate, to_rate);
+  }
+  return test::status();
+}
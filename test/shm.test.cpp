@@ -0,0 +1,114 @@
+// Runs a shared memory server rendering offline, and a client in a forked process :
+// checks that the blocks of the client are mixed into the output of the server,
+// that invalid commands are rejected, and that a second server can't use the same name.
+
+#include "../source/private.h"
+#include "test.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace imajuscule;
+using namespace imajuscule::audio;
+
+namespace {
+
+constexpr int n_client_blocks = 4;
+constexpr int block_size = 512;
+
+float sampleOfClient(int frame, int channel) {
+  return 0.001f * (1 + frame % 500) * (channel ? -1.f : 1.f);
+}
+
+// returns the exit status of the client process
+int runClient(std::string const & name, int sample_rate) {
+  shm::Client client(name);
+  if(!client.connected()) {
+    return 1;
+  }
+  if(client.sampleRate() != sample_rate) {
+    return 2;
+  }
+  // rejected by the server
+  if(client.openChannel(1.f, ChannelClosingPolicy::ExplicitClose, -1)) {
+    return 3;
+  }
+  auto channel = client.openChannel(1.f);
+  if(!channel) {
+    return 4;
+  }
+  for(int b = 0; b < n_client_blocks; ++b) {
+    int index;
+    float * block = client.acquireBlock(index);
+    if(!block) {
+      return 5;
+    }
+    for(int f = 0; f < shm::n_block_frames; ++f) {
+      for(int c = 0; c < shm::n_block_channels; ++c) {
+        block[f * shm::n_block_channels + c] = sampleOfClient(b * shm::n_block_frames + f, c);
+      }
+    }
+    if(!client.submitBlock(*channel, index, shm::n_block_frames)) {
+      return 6;
+    }
+  }
+  // the blocks that were submitted are played after the client is gone
+  return 0;
+}
+
+} // NS
+
+int main() {
+  auto const name = "test." + std::to_string(getpid());
+
+  AudioOut out;
+  shm::Server server(out, name);
+  TEST_CHECK(server.valid());
+  if(!server.valid()) {
+    return test::status();
+  }
+  {
+    shm::Server other(out, name);
+    TEST_CHECK(!other.valid());
+  }
+
+  auto const sample_rate = out.getSampleRate().value_or(AudioOut::AudioCtxt::lazySamplingRate);
+  auto const pid = fork();
+  TEST_CHECK(pid >= 0);
+  if(pid == 0) {
+    _exit(runClient(name, sample_rate));
+  }
+
+  // the frames of the client, as rendered by the server
+  std::vector<SAMPLE> mixed;
+  std::vector<SAMPLE> buffer(block_size * AudioOut::nAudioOut);
+  int status = -1;
+  bool exited = false;
+  for(int i = 0; i < 10000; ++i) {
+    // checked before processing, so that every command of the client is processed when it has exited
+    exited = exited || waitpid(pid, &status, WNOHANG) == pid;
+    server.process(std::chrono::milliseconds(1));
+    TEST_CHECK(out.renderOffline(buffer.data(), block_size));
+    // the channels of 'out' are silent : only the frames of the client are not zero
+    auto const n = std::count_if(buffer.begin(), buffer.end(), [](SAMPLE s) { return s != 0.f; });
+    std::copy_if(buffer.begin(), buffer.end(), std::back_inserter(mixed), [](SAMPLE s) { return s != 0.f; });
+    if(exited && n == 0) {
+      break;
+    }
+  }
+  if(!exited) {
+    waitpid(pid, &status, 0);
+  }
+  TEST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  if(WIFEXITED(status) && WEXITSTATUS(status)) {
+    std::fprintf(stderr, "the client failed (%d)\n", WEXITSTATUS(status));
+  }
+
+  TEST_CHECK(mixed.size() == static_cast<size_t>(n_client_blocks * shm::n_block_frames * shm::n_block_channels));
+  bool same = true;
+  for(int i = 0; i < static_cast<int>(mixed.size()); ++i) {
+    same = same && mixed[i] == sampleOfClient(i / shm::n_block_channels, i % shm::n_block_channels);
+  }
+  TEST_CHECK(same);
+  return test::status();
+}
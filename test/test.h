@@ -0,0 +1,30 @@
+#pragma once
+
+// Minimal checks for the tests : a failed check is reported and the test continues,
+// 'main' returns 'test::status()' so that ctest reports the failure.
+
+#include <cstdio>
+
+namespace imajuscule::test {
+
+inline int & failures() {
+  static int n = 0;
+  return n;
+}
+
+inline int status() {
+  if(failures()) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures());
+    return 1;
+  }
+  return 0;
+}
+
+} // NS imajuscule::test
+
+#define TEST_CHECK(cond) do {                                                    \
+  if(!(cond)) {                                                                  \
+    std::fprintf(stderr, "%s:%d : check failed : %s\n", __FILE__, __LINE__, #cond); \
+    ++imajuscule::test::failures();                                              \
+  }                                                                              \
+} while(0)
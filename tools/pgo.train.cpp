@@ -0,0 +1,101 @@
+// Training workload for profile guided optimization (see OS_AUDIO_PGO in CMakeLists.txt).
+//
+// It runs the realtime code paths of the library on synthetic signals,
+// with the block sizes and sample rates we use in production, without needing a device :
+// the channels of an 'AudioOut' are rendered with 'renderOffline', and the resampler
+// and the input analysis (compiled in the library) are fed directly.
+
+#include "../source/private.h"
+
+using namespace imajuscule;
+
+namespace {
+
+constexpr int n_seconds = 20;
+
+float signal(int i, int sample_rate) {
+  // a chirp, with silent periods, and a little noise
+  auto const t = static_cast<float>(i) / sample_rate;
+  auto const silent = (i / sample_rate) % 3 == 2;
+  auto const pseudo_random = static_cast<uint32_t>(i) * 1103515245u + 12345u;
+  auto const noise = 0.001f * (static_cast<float>(pseudo_random % 2001u) - 1000.f) / 1000.f;
+  return noise + (silent ? 0.f : 0.3f * std::sin(2.f * static_cast<float>(M_PI) * (100.f + 200.f * t) * t));
+}
+
+void trainResampling(int from_rate, int to_rate, int blockSize) {
+  constexpr int n_channels = 2;
+  audio::Resampler r(from_rate, to_rate, n_channels);
+  std::vector<float> in(blockSize * n_channels), out(r.maxOutputFrames(blockSize) * n_channels);
+  int i = 0;
+  for(int block = 0; block < n_seconds * from_rate / blockSize; ++block) {
+    for(int j = 0; j < blockSize; ++j, ++i) {
+      in[j * n_channels] = in[j * n_channels + 1] = signal(i, from_rate);
+    }
+    r.feed(in.data(), blockSize, out.data());
+  }
+}
+
+// Opens, fades and closes channels while rendering, like an application playing short sounds.
+bool trainRendering(int blockSize) {
+  constexpr int max_channels = 8;
+  audio::AudioOut out;
+  std::vector<SAMPLE> buffer(blockSize * audio::AudioOut::nAudioOut);
+  std::vector<uint8_t> channels;
+  for(int b = 0; b < n_seconds * SAMPLE_RATE / blockSize; ++b) {
+    if(b % 50 == 0) {
+      if(channels.size() < max_channels) {
+        channels.push_back(out.openChannel(0.f));
+      }
+      for(auto id : channels) {
+        out.toVolume(id, (b / 50) % 2 ? 1.f : 0.2f, 200);
+      }
+    }
+    if(b % 170 == 169) {
+      out.closeChannel(channels.front(), audio::CloseMode::NOW);
+      channels.erase(channels.begin());
+    }
+    if(!out.renderOffline(buffer.data(), blockSize)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#ifndef NO_AUDIO_IN
+void trainAnalysis(int sample_rate, int blockSize) {
+  std::atomic_flag used = ATOMIC_FLAG_INIT;
+  sensor::SpectralFeatures features(sample_rate, used);
+  sensor::SilenceGate gate;
+  std::vector<SAMPLE> block(blockSize);
+  int i = 0;
+  for(int b = 0; b < n_seconds * sample_rate / blockSize; ++b) {
+    float sumSquares = 0.f;
+    for(auto & s : block) {
+      s = signal(i++, sample_rate);
+      sumSquares += s * s;
+    }
+    if(gate.feed(std::sqrt(sumSquares / blockSize))) {
+      features.feed(block.data(), blockSize);
+    }
+    else {
+      features.silence();
+    }
+  }
+}
+#endif
+
+} // NS
+
+int main() {
+  for(int blockSize : {64, 256, 1024}) {
+    if(!trainRendering(blockSize)) {
+      return 1;
+    }
+    trainResampling(44100, 48000, blockSize);
+    trainResampling(48000, 44100, blockSize);
+#ifndef NO_AUDIO_IN
+    trainAnalysis(SAMPLE_RATE, blockSize);
+#endif
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+// Tries the shared memory server and client between local processes :
+//
+//   os.audio.shm.demo server <name>
+//   os.audio.shm.demo client <name>
+//
+// The server owns the audio device, the client opens a channel, changes its volume
+// and submits PCM blocks of a sine, which the server mixes into its output.
+
+#include "../source/private.h"
+
+using namespace imajuscule;
+using namespace imajuscule::audio;
+
+namespace {
+
+int runServer(std::string const & name) {
+  if(!Audio::Init(Audio::OutInitPolicy::FORCE)) {
+    LG(ERR, "could not initialize audio");
+    return 1;
+  }
+  shm::Server server(Audio::getInstance()->out(), name);
+  if(!server.valid()) {
+    return 1;
+  }
+  LG(INFO, "server '%s' is running", name.c_str());
+  while(true) {
+    server.process(std::chrono::milliseconds(1000));
+  }
+}
+
+int runClient(std::string const & name) {
+  shm::Client client(name);
+  if(!client.connected()) {
+    return 1;
+  }
+  auto channel = client.openChannel();
+  if(!channel) {
+    return 1;
+  }
+  if(!client.toVolume(*channel, 0.5f, 100)) {
+    return 1;
+  }
+  // the blocks are played at the rate of the channels of the server
+  float const increment = 2.f * static_cast<float>(M_PI) * 440.f / client.sampleRate();
+  float phase = 0.f;
+  for(int b = 0; b < 100;) {
+    int index;
+    float * block = client.acquireBlock(index);
+    if(!block) {
+      // the server didn't play the previous blocks yet
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    for(int f = 0; f < shm::n_block_frames; ++f) {
+      float const v = 0.2f * std::sin(phase);
+      phase = std::fmod(phase + increment, 2.f * static_cast<float>(M_PI));
+      for(int c = 0; c < shm::n_block_channels; ++c) {
+        block[f * shm::n_block_channels + c] = v;
+      }
+    }
+    if(!client.submitBlock(*channel, index, shm::n_block_frames)) {
+      return 1;
+    }
+    ++b;
+  }
+  return client.closeChannel(*channel, CloseMode::NOW) ? 0 : 1;
+}
+
+} // NS
+
+int main(int argc, const char * argv[]) {
+  if(argc != 3) {
+    LG(ERR, "usage : %s server|client <name>", argv[0]);
+    return 1;
+  }
+  std::string const mode(argv[1]);
+  if(mode == "server") {
+    return runServer(argv[2]);
+  }
+  if(mode == "client") {
+    return runClient(argv[2]);
+  }
+  LG(ERR, "unknown mode '%s'", mode.c_str());
+  return 1;
+}